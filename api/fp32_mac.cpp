@@ -18,134 +18,110 @@
 #include <string.h>
 #include <math.h>
 #include <inttypes.h>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 #include "fp32_mac.hpp"
+#include "ntx_trace.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// multiplier with extended output (2.46 bit mantissa, unnormalized exponent)
+///////////////////////////////////////////////////////////////////////////////
+static inline void fp32Mult (const uint32_t   opA,
+                             const uint32_t   opB,
+                                   bool     & sign,
+                                   int32_t  & exponent,
+                                   uint64_t & mantissa)
+{
+    exponent = fp32_getExp(opA) + fp32_getExp(opB) - C_FP32_BIAS;
+    mantissa = ((uint64_t) fp32_getMantFull(opA)) *
+               ((uint64_t) fp32_getMantFull(opB));
+    sign     = fp32_getSign(opA) ^ fp32_getSign(opB);
+
+    if(fp32_isZero(opA) || fp32_isZero(opB)) {
+        mantissa = 0ULL;
+        exponent = 0;
+    }
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // main FP MAC model
 ///////////////////////////////////////////////////////////////////////////////
-uint32_t  pcsMac ( const uint32_t    opA,
-                   const uint32_t    opB,
-                   const uint8_t     accuSel,
-                   const uint8_t     subEn,
-                   const uint8_t     normEn,
-                   fp32_accuType   & accuState,
-                   uint32_t        & res)
+static inline void extFp32ToPcsWin (const bool       sign,
+                                    const int32_t    exponent,
+                                    const uint64_t   mantissa,
+                                    fp32_accuType  & output);
+
+template <bool accuSel, bool normEn>
+uint32_t  pcsMacT ( const uint32_t    opA,
+                    const uint32_t    opB,
+                    const uint8_t     subEn,
+                    fp32_accuType   & accuState,
+                    uint32_t        & res)
 {
     bool     signTmp;
     int32_t  expTmp;
     uint64_t mantTmp;
     fp32_accuType tmp1;
 
-#ifdef FP32_DEBUG_ON
-    printf("----------------------------------------------\n");
-    printf("pcsMac called with args:\n");
-    printf("opA: %08X (interpreted: %e)\n", opA, fp32ToFloat(opA));
-    printf("opB: %08X (interpreted: %e)\n", opB, fp32ToFloat(opB));
-    printf("accuSel: %d\n", accuSel);
-    printf("subEn: %d\n", subEn);
-    printf("normEn: %d\n", normEn);
-    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>=0; k--)
-        printf("accuState.w[%d]: %016lX\n",k,accuState.w[k]);
-    fflush(stdout);
-#endif
-
+    NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_CALL, accuSel | (subEn<<1) | (normEn<<2), opA, opB, &accuState);
 
     // multiplication
-    expTmp  = fp32_getExp(opA) + fp32_getExp(opB) - C_FP32_BIAS;
-    mantTmp = ((uint64_t) fp32_getMantFull(opA)) *
-              ((uint64_t) fp32_getMantFull(opB));
-    signTmp = fp32_getSign(opA) ^ fp32_getSign(opB);
-
-    if(fp32_isZero(opA) || fp32_isZero(opB)) {
-        mantTmp = 0ULL;
-        expTmp  = 0;
-    }
+    fp32Mult(opA, opB, signTmp, expTmp, mantTmp);
 
-#ifdef FP32_DEBUG_ON
-    printf("--\n");
-    printf("after multiplication:\n");
-    printf("signTmp: %d\n", signTmp);
-    printf("expTmp: %02X\n", expTmp);
-    printf("mant: %016lX\n", mantTmp);
-    fflush(stdout);
-#endif
+    NTX_TRACE_WORDS(C_NTX_TRACE_PCS_MAC_MULT, 0, signTmp, expTmp, mantTmp, 0, 0);
 
     // convert this to fixed point representation
-    extFp32ToPcs(signTmp ^ (bool)subEn, expTmp, mantTmp, tmp1);
-
-#ifdef FP32_DEBUG_ON
-    printf("--\n");
-    printf("after conversion of mult out:\n");
-    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>=0; k--)
-        printf("tmp1.w[%d]: %016lX\n",k,tmp1.w[k]);
-    fflush(stdout);
-#endif
+    extFp32ToPcsWin(signTmp ^ (bool)subEn, expTmp, mantTmp, tmp1);
 
+    NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_EXT, 0, 0, 0, &tmp1);
 
     // use operand C if this is set
     if(accuSel) {
-        memcpy(accuState.w, tmp1.w, sizeof(uint64_t) * C_FP32_N_ACCU_WORDS);
+        accuState = tmp1;
+        accuState.expand();
     } else {
         // accumulation mode
         pcsAdd(tmp1, accuState, accuState);
     }
 
-
-#ifdef FP32_DEBUG_ON
-    printf("--\n");
-    printf("after accumulator:\n");
-    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>=0; k--)
-        printf("accuState.w[%d]: %016llX\n",k,accuState.w[k]);
-    fflush(stdout);
-#endif
-
+    NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_ACCU, 0, 0, 0, &accuState);
 
     // normalize the format only if needed
-    if(normEn)
+    if(normEn) {
         pcsToFp32(accuState, res);
-
-#ifdef FP32_DEBUG_ON
-    printf("--\n");
-    printf("after norm:\n");
-    printf("res: %08X (interpreted: %e)\n", res, fp32ToFloat(res));
-    printf("----------------------------------------------\n");
-    fflush(stdout);
-#endif
+        NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_NORM, 0, res, 0, (const fp32_accuType *)nullptr);
+    }
 
     return 0;
 }
 
+template uint32_t pcsMacT<false, false> (const uint32_t, const uint32_t, const uint8_t, fp32_accuType &, uint32_t &);
+template uint32_t pcsMacT<false, true > (const uint32_t, const uint32_t, const uint8_t, fp32_accuType &, uint32_t &);
+template uint32_t pcsMacT<true,  false> (const uint32_t, const uint32_t, const uint8_t, fp32_accuType &, uint32_t &);
+template uint32_t pcsMacT<true,  true > (const uint32_t, const uint32_t, const uint8_t, fp32_accuType &, uint32_t &);
 
-///////////////////////////////////////////////////////////////////////////////
-// sign inversion of the accumulator
-///////////////////////////////////////////////////////////////////////////////
-void pcsInv (const fp32_accuType & in,
-                   fp32_accuType & out)
+uint32_t  pcsMac ( const uint32_t    opA,
+                   const uint32_t    opB,
+                   const uint8_t     accuSel,
+                   const uint8_t     subEn,
+                   const uint8_t     normEn,
+                   fp32_accuType   & accuState,
+                   uint32_t        & res)
 {
-    uint64_t tmp;
-    uint64_t carryIn = 1ULL;
-
-    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
-    {
-        tmp = (~in.w[k]) + carryIn;
-
-        // check if we have to carry over
-        if((tmp < (~in.w[k])) || (tmp < carryIn))
-        {
-            carryIn = 1ULL;
-        }
-        else
-        {
-            carryIn = 0ULL;
-        }
-
-        out.w[k] = tmp;
-    }
-
-    return;
+    if(accuSel)
+        return normEn ? pcsMacT<true,  true >(opA, opB, subEn, accuState, res) :
+                        pcsMacT<true,  false>(opA, opB, subEn, accuState, res);
+    else
+        return normEn ? pcsMacT<false, true >(opA, opB, subEn, accuState, res) :
+                        pcsMacT<false, false>(opA, opB, subEn, accuState, res);
 }
 
+
 ///////////////////////////////////////////////////////////////////////////////
 // used to convert the extended multipler output to the accumulator
 // representation
@@ -153,50 +129,87 @@ void pcsInv (const fp32_accuType & in,
 // plus mantissa plus range.
 // we use the full multiplier output, which is 2.46 bit, but we have to cut
 // away 23bits at the bottom if the exponent is below 23.
+// the windowed version only writes the one or two words hit by the mantissa,
+// all other words are outside of the live window of the output.
+// a table of the word offset and shifts per exponent, without the branch on
+// the spill, is not faster (see test/benchExtFp32.cpp).
 ///////////////////////////////////////////////////////////////////////////////
-void extFp32ToPcs (const bool     & sign,
-                   const int32_t  & exponent,
-                   const uint64_t & mantissa,
-                   fp32_accuType  & output)
+static inline void extFp32ToPcsWin (const bool       sign,
+                                    const int32_t    exponent,
+                                    const uint64_t   mantissa,
+                                    fp32_accuType  & output)
 {
 
-    memset(output.w, 0, sizeof(uint64_t) * C_FP32_N_ACCU_WORDS);
-
     int32_t  tmpExp  = exponent;
     uint64_t tmpMant = mantissa;
 
+    output.neg = false;
+
     if(tmpExp < 0) {
-            return;
+        output.lo = C_FP32_N_ACCU_WORDS;
+        output.hi = -1;
+        return;
     } else if(tmpExp >= C_FP32_EXP_MASK_ALIGNED) {
         // models the same behavior as HW
         tmpExp = C_FP32_EXP_MASK_ALIGNED;
         tmpMant = (1ULL << (C_FP32_MANT_WIDTH*2));
     }
 
+    if(!tmpMant) {
+        output.lo = C_FP32_N_ACCU_WORDS;
+        output.hi = -1;
+        return;
+    }
+
     int32_t shiftSize = tmpExp - C_FP32_MANT_WIDTH;
+    int32_t off       = 0;
+    uint64_t lower, upper = 0ULL;
 
     if(shiftSize<0) {
-        output.w[0] = tmpMant >> -shiftSize;
+        lower = tmpMant >> -shiftSize;
     } else {
         // determine 64bit word offset before shifting
-        int32_t off = shiftSize >> 6;// /64
+        off = shiftSize >> 6;// /64
         shiftSize &= 0x3F;// %64
 
-        output.w[off] = tmpMant << shiftSize;
+        lower = tmpMant << shiftSize;
 
         // upper part may spill over into the next 64bit word...
         if((shiftSize + (2 + 2*C_FP32_MANT_WIDTH)) > 64) {
-            output.w[off+1] = tmpMant >> (64-shiftSize);
+            upper = tmpMant >> (64-shiftSize);
         }
     }
 
-    // invert sign if needed
-    if(sign)
-        pcsInv(output, output);
+    // invert sign if needed (without branching, since the sign is random).
+    // all words above the window turn into ones, unless everything has
+    // been shifted out.
+    const uint64_t signMask = sign ? ~0ULL : 0ULL;
+    uint64_t carry = sign;
+
+    lower  = (lower ^ signMask) + carry;
+    carry &= (lower == 0ULL);
+    upper  = (upper ^ signMask) + carry;
+    carry &= (upper == 0ULL);
+
+    // the window always spans two words, the mantissa is 48bit wide
+    output.w[off]   = lower;
+    output.w[off+1] = upper;
+    output.lo       = off;
+    output.hi       = off+1;
+    output.neg      = sign && !carry;
 
     return;
 }
 
+void extFp32ToPcs (const bool     & sign,
+                   const int32_t  & exponent,
+                   const uint64_t & mantissa,
+                   fp32_accuType  & output)
+{
+    extFp32ToPcsWin(sign, exponent, mantissa, output);
+    output.expand();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // converts the fp32 representation to the pcs format used in the accumulator
 ///////////////////////////////////////////////////////////////////////////////
@@ -220,65 +233,49 @@ void fp32ToPcs (const    fp32  & input,
 ///////////////////////////////////////////////////////////////////////////////
 // backwards conversion to fp32 datatype
 ///////////////////////////////////////////////////////////////////////////////
+static void pcsInvWin (const fp32_accuType & in,
+                             fp32_accuType & out);
+
 void pcsToFp32 (const fp32_accuType & input,
                 fp32                & output)
 {
 
     int32_t  tmpExp, off, lzCnt;
-    fp32_accuType tmpIn;
+    fp32_accuType tmpInv;
+    const fp32_accuType * tmpIn = &input;
     output = 0;
 
     // check sign bit and invert if necessary
-    if(input.w[C_FP32_N_ACCU_WORDS-1] >> 63) {
+    if(input.isNeg()) {
         output  = C_FP32_SIGN_MASK;
-        pcsInv(input, tmpIn);
-    } else {
-        memcpy(tmpIn.w, input.w, sizeof(uint64_t) * C_FP32_N_ACCU_WORDS);
+        pcsInvWin(input, tmpInv);
+        tmpIn = &tmpInv;
     }
 
-#ifdef FP32_DEBUG_ON
-    printf("--\n");
-    printf("pcsToFp32:\n");
-#endif
-
-#ifdef FP32_DEBUG_ON
-    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>=0; k--)
-        printf("accuState.w[%d]: %016llX\n",k,tmpIn.w[k]);
-    fflush(stdout);
-#endif
-
-    // determine exponent
-    tmpExp = C_FP32_N_ACCU_WORDS * 64 - C_FP32_MANT_WIDTH -1;
-
-#ifdef FP32_DEBUG_ON
-    printf("tmpExp[init] = %d\n",tmpExp);
-#endif
+    // determine exponent. the words above the live window are zero at
+    // this point, so we can start the search at the top of the window
+    off    = std::min(tmpIn->hi, C_FP32_N_ACCU_WORDS-1);
+    tmpExp = (off + 1) * 64 - C_FP32_MANT_WIDTH -1;
 
     lzCnt  = 0;
-    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>= 0; k--) {
-        off = k;
+    for(; off >= tmpIn->lo; off--) {
 
-        if(tmpIn.w[k]) {
+        if(tmpIn->w[off]) {
 
-            lzCnt = __builtin_clzll(tmpIn.w[k]);
-            // lzCnt = __builtin_clzl(tmpIn.w[k]);
+            lzCnt = __builtin_clzll(tmpIn->w[off]);
+            // lzCnt = __builtin_clzl(tmpIn->w[off]);
 
             tmpExp -= lzCnt;
 
-#ifdef FP32_DEBUG_ON
-            printf("lzCnt[k=%d]  = %d\n",k,lzCnt);
-            printf("tmpExp[k=%d] = %d\n",k,tmpExp);
-#endif
-
             break;
         } else {
             tmpExp -= 64;
         }
     }
 
-#ifdef FP32_DEBUG_ON
-    printf("tmpExp[end] = %d\n",tmpExp);
-#endif
+    // accumulator is zero
+    if(off < tmpIn->lo)
+        tmpExp = -1;
 
     // extract mantissa
     if(tmpExp < 0) {
@@ -293,34 +290,255 @@ void pcsToFp32 (const fp32_accuType & input,
         lzCnt = 64-1-C_FP32_MANT_WIDTH-lzCnt;
         if (lzCnt >= 0) {
             // cut the MSB away and pack
-            output |= (tmpIn.w[off] >> lzCnt) & C_FP32_MANT_MASK;
+            output |= (tmpIn->w[off] >> lzCnt) & C_FP32_MANT_MASK;
         } else { // in this case we have to assemble the mantissa...
             // cut the MSB away and pack
-            output |= (tmpIn.w[off] << -lzCnt) & C_FP32_MANT_MASK;
-            output |= (tmpIn.w[off-1] >> (64 + lzCnt));
+            output |= (tmpIn->w[off] << -lzCnt) & C_FP32_MANT_MASK;
+            output |= (tmpIn->word(off-1) >> (64 + lzCnt));
         }
     }
+
+    NTX_TRACE_PCS(C_NTX_TRACE_PCS_TO_FP32, 0, tmpExp, output, tmpIn);
     return;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// addition routine on accumulator datatypes
+// batched conversion to fp32. the per element versions below are free of data
+// dependent branches, so that a batch of accumulators with random signs and
+// magnitudes does not suffer from mispredictions. they are bit-true to
+// pcsToFp32.
 ///////////////////////////////////////////////////////////////////////////////
-void pcsAdd (const fp32_accuType & opA,
-             const fp32_accuType & opB,
-                   fp32_accuType & out)
+
+typedef void (*pcsToFp32BatchFuncType) (const fp32_accuType * input,
+                                              fp32          * output,
+                                        const uint32_t        n);
+
+// packs sign, exponent and the normalized mantissa (msb at bit 63)
+static inline fp32 pcsPackFp32 (const uint32_t sign,
+                                const int32_t  exponent,
+                                const uint64_t mantissa)
 {
-    uint64_t tmp;
-    int64_t tmp2;
-    uint64_t carryIn = 0ULL, carryOut;
+    const fp32 val = (exponent < 0) ? C_FP32_ZERO_VAL :
+                     (exponent >= C_FP32_EXP_MASK_ALIGNED) ? C_FP32_INF_VAL :
+                     (((uint32_t)exponent << C_FP32_MANT_WIDTH) |
+                      ((uint32_t)(mantissa >> (63 - C_FP32_MANT_WIDTH)) & C_FP32_MANT_MASK));
+    return (sign << 31) | val;
+}
+
+static inline fp32 pcsToFp32Flat (const fp32_accuType & input)
+{
+    const uint64_t sign = input.isNeg();
+    const uint64_t signMask = 0ULL - sign;
+    uint64_t carry = sign;
+    uint64_t mag, prev = 0ULL, upper = 0ULL, lower = 0ULL;
+    int32_t  top = -1;
 
+    // negate if necessary, and find the topmost non zero word
     for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        mag    = (input.word(k) ^ signMask) + carry;
+        carry &= (mag == 0ULL);
+        top    = mag ? k    : top;
+        upper  = mag ? mag  : upper;
+        lower  = mag ? prev : lower;
+        prev   = mag;
+    }
+
+    // the second shift is split up to stay below 64
+    const int32_t  lzCnt = upper ? __builtin_clzll(upper) : 0;
+    const uint64_t mant  = (upper << lzCnt) | ((lower >> 1) >> (63 - lzCnt));
+    const int32_t  exp   = (top < 0) ? -1 : (top + 1) * 64 - C_FP32_MANT_WIDTH - 1 - lzCnt;
 
-        tmp = opA.w[k] + opB.w[k];
+    return pcsPackFp32(sign, exp, mant);
+}
+
+static void pcsToFp32BatchScalar (const fp32_accuType * input,
+                                        fp32          * output,
+                                  const uint32_t        n)
+{
+    for(uint32_t k = 0; k<n; k++)
+        output[k] = pcsToFp32Flat(input[k]);
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FP32_HAVE_BATCH_AVX512
+
+// some GCC versions warn about the undefined upper halves used inside of
+// the AVX-512 intrinsics headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// same as pcsToFp32Flat, but for 8 accumulators at once. the words are
+// gathered from the accumulators, and the window is resolved with masks.
+__attribute__((target("avx512f,avx512cd")))
+static void pcsToFp32BatchAvx512 (const fp32_accuType * input,
+                                        fp32          * output,
+                                  const uint32_t        n)
+{
+    const int64_t  stride = sizeof(fp32_accuType);
+    const __m512i  idx    = _mm512_set_epi64(7*stride, 6*stride, 5*stride, 4*stride,
+                                             3*stride, 2*stride, 1*stride, 0);
+    const __m512i  zero   = _mm512_setzero_si512();
+    const __m512i  one    = _mm512_set1_epi64(1);
+
+    // note: fp32_accuType is not standard layout, so offsetof cannot be used
+    const int64_t  offLo  = (const char *)&input->lo  - (const char *)input;
+    const int64_t  offHi  = (const char *)&input->hi  - (const char *)input;
+    const int64_t  offNeg = (const char *)&input->neg - (const char *)input;
+
+    uint32_t k = 0;
+    for(; k+8<=n; k+=8) {
+        const char * base = (const char *)(input + k);
+
+        // window of the accumulators
+        const __m512i lo   = _mm512_cvtepi32_epi64(_mm512_i64gather_epi32(idx, base + offLo, 1));
+        const __m512i hi   = _mm512_cvtepi32_epi64(_mm512_i64gather_epi32(idx, base + offHi, 1));
+        const __m512i negF = _mm512_and_si512(_mm512_cvtepi32_epi64(_mm512_i64gather_epi32(idx, base + offNeg, 1)),
+                                              _mm512_set1_epi64(0xFF));
+
+        // sign, see fp32_accuType::isNeg
+        const __m512i  wTop    = _mm512_i64gather_epi64(idx, base + 8*(C_FP32_N_ACCU_WORDS-1), 1);
+        const __mmask8 full    = _mm512_cmpge_epi64_mask(hi, _mm512_set1_epi64(C_FP32_N_ACCU_WORDS-1));
+        const __mmask8 nonEmpt = _mm512_cmple_epi64_mask(lo, hi);
+        const __mmask8 negTop  = _mm512_cmplt_epi64_mask(wTop, zero) & nonEmpt;
+        const __mmask8 negWin  = _mm512_cmpneq_epi64_mask(negF, zero);
+        const __mmask8 neg     = (full & negTop) | (~full & negWin);
+        const __mmask8 negExt  = negWin;
+
+        const __m512i signMask = _mm512_maskz_set1_epi64(neg, -1);
+        __m512i carry = _mm512_maskz_mov_epi64(neg, one);
+        __m512i prev  = zero, upper = zero, lower = zero;
+        __m512i top   = _mm512_set1_epi64(-1);
+
+        for(int32_t w = 0; w<C_FP32_N_ACCU_WORDS; w++) {
+            const __m512i  kk    = _mm512_set1_epi64(w);
+            const __m512i  raw   = _mm512_i64gather_epi64(idx, base + 8*w, 1);
+            const __mmask8 above = _mm512_cmpgt_epi64_mask(kk, hi);
+            const __mmask8 below = _mm512_cmplt_epi64_mask(kk, lo);
+            // see fp32_accuType::word
+            __m512i word = _mm512_maskz_mov_epi64(~below, raw);
+            word = _mm512_mask_mov_epi64(word, above, _mm512_maskz_set1_epi64(negExt, -1));
+
+            const __m512i  mag = _mm512_add_epi64(_mm512_xor_si512(word, signMask), carry);
+            const __mmask8 nz  = _mm512_cmpneq_epi64_mask(mag, zero);
+            carry = _mm512_maskz_mov_epi64(~nz, carry);
+            top   = _mm512_mask_mov_epi64(top, nz, kk);
+            upper = _mm512_mask_mov_epi64(upper, nz, mag);
+            lower = _mm512_mask_mov_epi64(lower, nz, prev);
+            prev  = mag;
+        }
+
+        // shift counts above 63 yield zero, so no special cases are needed
+        const __m512i lzCnt = _mm512_maskz_mov_epi64(_mm512_cmpneq_epi64_mask(upper, zero),
+                                                     _mm512_lzcnt_epi64(upper));
+        const __m512i mant  = _mm512_or_si512(_mm512_sllv_epi64(upper, lzCnt),
+                                              _mm512_srlv_epi64(lower, _mm512_sub_epi64(_mm512_set1_epi64(64), lzCnt)));
+        __m512i exp = _mm512_sub_epi64(_mm512_slli_epi64(_mm512_add_epi64(top, one), 6),
+                                       _mm512_add_epi64(lzCnt, _mm512_set1_epi64(C_FP32_MANT_WIDTH + 1)));
+        exp = _mm512_mask_mov_epi64(exp, _mm512_cmplt_epi64_mask(top, zero), _mm512_set1_epi64(-1));
+
+        // pack
+        const __mmask8 isZero = _mm512_cmplt_epi64_mask(exp, zero);
+        const __mmask8 isInf  = _mm512_cmpge_epi64_mask(exp, _mm512_set1_epi64(C_FP32_EXP_MASK_ALIGNED));
+        __m512i res = _mm512_or_si512(_mm512_slli_epi64(exp, C_FP32_MANT_WIDTH),
+                                      _mm512_and_si512(_mm512_srli_epi64(mant, 63 - C_FP32_MANT_WIDTH),
+                                                       _mm512_set1_epi64(C_FP32_MANT_MASK)));
+        res = _mm512_mask_mov_epi64(res, isInf, _mm512_set1_epi64(C_FP32_INF_VAL));
+        res = _mm512_maskz_mov_epi64(~isZero, res);
+        res = _mm512_mask_or_epi64(res, neg, res, _mm512_set1_epi64(C_FP32_SIGN_MASK));
+
+        _mm256_storeu_si256((__m256i *)(output + k), _mm512_cvtepi64_epi32(res));
+    }
+
+    pcsToFp32BatchScalar(input + k, output + k, n - k);
+}
+#pragma GCC diagnostic pop
+
+static bool pcsHostHasAvx512()
+{
+    // also checks whether the OS saves the AVX-512 state
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd");
+}
+#endif
+
+static pcsToFp32BatchFuncType pcsToFp32BatchImpl = pcsToFp32BatchScalar;
+
+static bool pcsAutoSelectToFp32Batch ()
+{
+#ifdef FP32_HAVE_BATCH_AVX512
+    if(pcsHostHasAvx512()) {
+        pcsToFp32BatchImpl = pcsToFp32BatchAvx512;
+        return true;
+    }
+#endif
+    return false;
+}
+
+static const bool pcsToFp32BatchAtStartup = pcsAutoSelectToFp32Batch();
+
+bool pcsHasBatchAvx512 ()
+{
+#ifdef FP32_HAVE_BATCH_AVX512
+    return pcsHostHasAvx512();
+#else
+    return false;
+#endif
+}
+
+bool pcsSetBatchAvx512 (const bool enable)
+{
+    if(!enable) {
+        pcsToFp32BatchImpl = pcsToFp32BatchScalar;
+        return true;
+    }
+#ifdef FP32_HAVE_BATCH_AVX512
+    if(pcsHostHasAvx512()) {
+        pcsToFp32BatchImpl = pcsToFp32BatchAvx512;
+        return true;
+    }
+#endif
+    return false;
+}
+
+void pcsToFp32Batch (const fp32_accuType * input,
+                           fp32          * output,
+                     const uint32_t        n)
+{
+    pcsToFp32BatchImpl(input, output, n);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// carry chain backends for pcsAdd and pcsInv
+// these two functions run on every emulated MAC, so there are several
+// implementations of the carry chain. all of them are bit-true to the
+// reference implementation, the fastest one supported by the host is
+// selected at startup (see pcsSetBackend). a backend provides the add with
+// carry primitive, which is inlined into the windowed pcsAdd/pcsInv below.
+///////////////////////////////////////////////////////////////////////////////
+
+typedef void (*pcsInvFuncType) (const fp32_accuType & in,
+                                      fp32_accuType & out);
+
+typedef void (*pcsAddFuncType) (const fp32_accuType & opA,
+                                const fp32_accuType & opB,
+                                      fp32_accuType & out);
+
+///////////////////////////////////////////////////////////////////////////////
+// reference implementation (compare-and-branch carry detection)
+///////////////////////////////////////////////////////////////////////////////
+struct pcsBackendRef {
+    // computes opA + opB + carryIn and returns the carry out
+    static inline uint64_t addCarry(const uint64_t   opA,
+                                    const uint64_t   opB,
+                                    const uint64_t   carryIn,
+                                          uint64_t & out)
+    {
+        uint64_t tmp, carryOut;
+
+        tmp = opA + opB;
 
         // check if we have to carry over
-        if((tmp < opA.w[k]) || (tmp < opB.w[k])) {
+        if((tmp < opA) || (tmp < opB)) {
             carryOut = 1ULL;
         } else if ((carryIn == 1ULL) && (tmp == 0xFFFFFFFFFFFFFFFFULL)){
             carryOut = 1ULL;
@@ -330,25 +548,677 @@ void pcsAdd (const fp32_accuType & opA,
 
         tmp += carryIn;
 
-#ifdef FP32_DEBUG_ON
-    printf("--\n");
-    printf("pcsAdd:\n");
-    printf("out[%d]: %016lX = opA.w + opB.w + carryIn = %016lX  + %016lX + %lu, carryOut: %lu\n", k, tmp, opA.w[k], opB.w[k], carryIn, carryOut);
-    fflush(stdout);
+        NTX_TRACE_WORDS(C_NTX_TRACE_PCS_ADD_WORD, carryIn | (carryOut<<1), 0, 0, tmp, opA, opB);
+
+        out = tmp;
+        return carryOut;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// portable implementation (add with carry builtins or 128bit arithmetic)
+///////////////////////////////////////////////////////////////////////////////
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_addcll)
+#define FP32_HAVE_BUILTIN_ADDC
+#endif
+#endif
+
+#if defined(FP32_HAVE_BUILTIN_ADDC) || defined(__SIZEOF_INT128__)
+#define FP32_HAVE_PCS_BACKEND_PORTABLE
+
+struct pcsBackendPortable {
+    static inline uint64_t addCarry(const uint64_t   opA,
+                                    const uint64_t   opB,
+                                    const uint64_t   carryIn,
+                                          uint64_t & out)
+    {
+#ifdef FP32_HAVE_BUILTIN_ADDC
+        unsigned long long carryOut;
+        out = __builtin_addcll(opA, opB, carryIn, &carryOut);
+        return carryOut;
+#else
+        unsigned __int128 tmp = (unsigned __int128)opA + opB + carryIn;
+        out = (uint64_t)tmp;
+        return (uint64_t)(tmp >> 64);
+#endif
+    }
+};
 #endif
 
-        carryIn  = carryOut;
-        out.w[k] = tmp;
+///////////////////////////////////////////////////////////////////////////////
+// x86 implementation using the ADX add-with-carry instructions
+///////////////////////////////////////////////////////////////////////////////
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FP32_HAVE_PCS_BACKEND_ADX
+
+struct pcsBackendAdx {
+    __attribute__((target("adx")))
+    static inline uint64_t addCarry(const uint64_t   opA,
+                                    const uint64_t   opB,
+                                    const uint64_t   carryIn,
+                                          uint64_t & out)
+    {
+        unsigned long long tmp;
+        uint64_t carryOut = _addcarryx_u64((unsigned char)carryIn, opA, opB, &tmp);
+        out = tmp;
+        return carryOut;
     }
+};
+
+static bool pcsHostHasAdx()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+    // CPUID.(EAX=07H, ECX=0H):EBX.ADX[bit 19]
+    return (ebx >> 19) & 0x1;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// windowed accumulator arithmetic, templated on the backend
+///////////////////////////////////////////////////////////////////////////////
 
-    // we need to accurately model overflows in the HW that were
-    // not detected due to insufficient amount of guard bits
-    // so mask away all bits above the overflow guard bits
-    tmp = 64 - (C_FP32_PCS_WIDTH & 0x3F);
-    tmp2 = out.w[C_FP32_N_ACCU_WORDS-1] << tmp;
+// we need to accurately model overflows in the HW that were
+// not detected due to insufficient amount of guard bits
+// so mask away all bits above the overflow guard bits
+static inline uint64_t pcsMaskOflow(const uint64_t in)
+{
+    const uint32_t shift = 64 - (C_FP32_PCS_WIDTH & 0x3F);
     // and sign extend this again (note: use signed number to implement arithmetic shift)
-    out.w[C_FP32_N_ACCU_WORDS-1] = tmp2 >> tmp;
+    return (uint64_t)(((int64_t)(in << shift)) >> shift);
+}
 
-    return;
+// materialize the words of acc such that its window covers [lo, hi]
+static inline void pcsWiden (      fp32_accuType & acc,
+                             const int32_t         lo,
+                             const int32_t         hi)
+{
+    // note: an empty negative window has ones in all words
+    if(acc.lo > acc.hi) {
+        acc.lo = acc.neg ? 0 : lo;
+        acc.hi = acc.lo - 1;
+    }
+
+    const uint64_t ext = acc.neg ? ~0ULL : 0ULL;
+    for(int32_t k = acc.hi+1; k<=hi; k++)
+        acc.w[k] = ext;
+    for(int32_t k = lo; k<acc.lo; k++)
+        acc.w[k] = 0ULL;
+
+    acc.lo = std::min(acc.lo, lo);
+    acc.hi = std::max(acc.hi, hi);
+}
+
+// the words above the window of acc evaluate to ext (in {-2,...,1}) after an
+// operation. this may spill into one more word below the top word.
+static inline void pcsSetExt (      fp32_accuType & acc,
+                              const int64_t         ext)
+{
+    if(acc.hi < C_FP32_N_ACCU_WORDS-1) {
+        acc.neg = ext < 0;
+        if((uint64_t)ext != (acc.neg ? ~0ULL : 0ULL)) {
+            acc.hi++;
+            acc.w[acc.hi] = (uint64_t)ext;
+            if(acc.lo > acc.hi)
+                acc.lo = acc.hi;
+        }
+    }
 }
 
+// shrink the window of acc to the words that actually differ from zero
+// (below) and the sign extension (above)
+static inline void pcsTrim (fp32_accuType & acc)
+{
+    acc.neg = acc.isNeg();
+    const uint64_t ext = acc.neg ? ~0ULL : 0ULL;
+    while(acc.hi >= acc.lo && acc.w[acc.hi] == ext)
+        acc.hi--;
+    while(acc.lo <= acc.hi && acc.w[acc.lo] == 0ULL)
+        acc.lo++;
+    if(acc.lo > acc.hi)
+        acc.lo = C_FP32_N_ACCU_WORDS;
+}
+
+// acc += op. the carry chain starts at the bottom of the window of op and
+// runs up to the top word, adding the sign extension of op above its window.
+// running the chain up to the top keeps it free of data dependent branches,
+// which is cheaper than tracking the upper end of the window of acc.
+template <class B>
+static inline void pcsAccumulate (      fp32_accuType & acc,
+                                  const fp32_accuType & op)
+{
+    // nothing to do when adding zero, e.g. when only normalizing
+    if(op.lo > op.hi && !op.isNeg())
+        return;
+
+    const int32_t  hi  = op.hi;
+    const int32_t  lo  = std::min(op.lo, hi+1);
+    const uint64_t ext = op.neg ? ~0ULL : 0ULL;
+    uint64_t carry = 0ULL;
+
+    pcsWiden(acc, lo, C_FP32_N_ACCU_WORDS-1);
+
+    int32_t k = lo;
+    for(; k<=hi; k++)
+        carry = B::addCarry(acc.w[k], op.w[k], carry, acc.w[k]);
+
+    for(; k<C_FP32_N_ACCU_WORDS; k++)
+        carry = B::addCarry(acc.w[k], ext, carry, acc.w[k]);
+
+    acc.w[C_FP32_N_ACCU_WORDS-1] = pcsMaskOflow(acc.w[C_FP32_N_ACCU_WORDS-1]);
+}
+
+template <class B>
+static void pcsAddT (const fp32_accuType & opA,
+                     const fp32_accuType & opB,
+                           fp32_accuType & out)
+{
+    if(&out == &opB) {
+        // accumulation mode, as used in pcsMac
+        if(&opA == &opB) {
+            const fp32_accuType tmp = opA;
+            pcsAccumulate<B>(out, tmp);
+        } else {
+            pcsAccumulate<B>(out, opA);
+        }
+    } else if(&out == &opA) {
+        pcsAccumulate<B>(out, opB);
+    } else {
+        out = opB;
+        pcsAccumulate<B>(out, opA);
+    }
+}
+
+template <class B>
+static void pcsInvT (const fp32_accuType & in,
+                           fp32_accuType & out)
+{
+    // words below the window stay zero and produce a carry into the window
+    const int32_t hi    = in.hi;
+    const int32_t lo    = std::min(in.lo, hi+1);
+    const int64_t ext   = ((hi < C_FP32_N_ACCU_WORDS-1) && in.neg) ? 0 : -1;
+    uint64_t      carry = 1ULL;
+
+    for(int32_t k = lo; k<=hi; k++)
+        carry = B::addCarry(~in.w[k], 0ULL, carry, out.w[k]);
+
+    out.lo = lo;
+    out.hi = hi;
+    pcsSetExt(out, ext + (int64_t)carry);
+    pcsTrim(out);
+}
+
+#ifdef FP32_HAVE_PCS_BACKEND_ADX
+// the add with carry primitive can only be inlined into functions that are
+// compiled for ADX as well
+__attribute__((target("adx"), flatten))
+static void pcsInvAdx (const fp32_accuType & in,
+                             fp32_accuType & out)
+{
+    pcsInvT<pcsBackendAdx>(in, out);
+}
+
+__attribute__((target("adx"), flatten))
+static void pcsAddAdx (const fp32_accuType & opA,
+                       const fp32_accuType & opB,
+                             fp32_accuType & out)
+{
+    pcsAddT<pcsBackendAdx>(opA, opB, out);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// backend selection
+///////////////////////////////////////////////////////////////////////////////
+
+// the reference backend is always safe to use, also from within other static
+// initializers that may run before the host detection below
+static pcsInvFuncType pcsInvImpl = pcsInvT<pcsBackendRef>;
+static pcsAddFuncType pcsAddImpl = pcsAddT<pcsBackendRef>;
+static uint32_t       pcsBackend = C_FP32_PCS_BACKEND_REF;
+
+bool pcsHasBackend (const uint32_t backend)
+{
+    switch(backend) {
+        case C_FP32_PCS_BACKEND_REF:
+            return true;
+#ifdef FP32_HAVE_PCS_BACKEND_PORTABLE
+        case C_FP32_PCS_BACKEND_PORTABLE:
+            return true;
+#endif
+#ifdef FP32_HAVE_PCS_BACKEND_ADX
+        case C_FP32_PCS_BACKEND_ADX:
+            return pcsHostHasAdx();
+#endif
+        default:
+            return false;
+    }
+}
+
+bool pcsSetBackend (const uint32_t backend)
+{
+    if(!pcsHasBackend(backend))
+        return false;
+
+    switch(backend) {
+#ifdef FP32_HAVE_PCS_BACKEND_PORTABLE
+        case C_FP32_PCS_BACKEND_PORTABLE:
+            pcsInvImpl = pcsInvT<pcsBackendPortable>;
+            pcsAddImpl = pcsAddT<pcsBackendPortable>;
+            break;
+#endif
+#ifdef FP32_HAVE_PCS_BACKEND_ADX
+        case C_FP32_PCS_BACKEND_ADX:
+            pcsInvImpl = pcsInvAdx;
+            pcsAddImpl = pcsAddAdx;
+            break;
+#endif
+        default:
+            pcsInvImpl = pcsInvT<pcsBackendRef>;
+            pcsAddImpl = pcsAddT<pcsBackendRef>;
+            break;
+    }
+
+    pcsBackend = backend;
+    return true;
+}
+
+uint32_t pcsGetBackend ()
+{
+    return pcsBackend;
+}
+
+// pick the fastest backend available on this host
+static uint32_t pcsAutoSelectBackend ()
+{
+    static const uint32_t prio[] = {C_FP32_PCS_BACKEND_ADX,
+                                    C_FP32_PCS_BACKEND_PORTABLE,
+                                    C_FP32_PCS_BACKEND_REF};
+
+#ifdef NTX_TRACE_ON
+    // keep the per-word trace points of the reference backend
+    pcsSetBackend(C_FP32_PCS_BACKEND_REF);
+    return pcsBackend;
+#endif
+
+    for(uint32_t k = 0; k < sizeof(prio)/sizeof(prio[0]); k++) {
+        if(pcsSetBackend(prio[k]))
+            break;
+    }
+    return pcsBackend;
+}
+
+static const uint32_t pcsBackendAtStartup = pcsAutoSelectBackend();
+
+///////////////////////////////////////////////////////////////////////////////
+// sign inversion of the accumulator
+///////////////////////////////////////////////////////////////////////////////
+// the output keeps its live window, for the temporaries of this file
+static void pcsInvWin (const fp32_accuType & in,
+                             fp32_accuType & out)
+{
+    pcsInvImpl(in, out);
+}
+
+void pcsInv (const fp32_accuType & in,
+                   fp32_accuType & out)
+{
+    pcsInvImpl(in, out);
+    out.expand();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// addition routine on accumulator datatypes
+///////////////////////////////////////////////////////////////////////////////
+void pcsAdd (const fp32_accuType & opA,
+             const fp32_accuType & opB,
+                   fp32_accuType & out)
+{
+    pcsAddImpl(opA, opB, out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// deferred carry accumulator
+///////////////////////////////////////////////////////////////////////////////
+
+// adds the extended multiplier output to the segments of accu. the cut at the
+// bottom and the saturation behave exactly like in extFp32ToPcs.
+static inline void extFp32AddCs (const bool        sign,
+                                 const int32_t     exponent,
+                                 const uint64_t    mantissa,
+                                 fp32_csAccuType & accu)
+{
+    // the split below assumes that the mantissa spans at most three segments
+    static_assert(C_FP32_CS_SEG_LEN == 32, "extFp32AddCs expects 32bit segments");
+
+    int32_t  tmpExp  = exponent;
+    uint64_t tmpMant = mantissa;
+
+    if(tmpExp < 0) {
+        return;
+    } else if(tmpExp >= C_FP32_EXP_MASK_ALIGNED) {
+        // models the same behavior as HW
+        tmpExp = C_FP32_EXP_MASK_ALIGNED;
+        tmpMant = (1ULL << (C_FP32_MANT_WIDTH*2));
+    }
+
+    int32_t shiftSize = tmpExp - C_FP32_MANT_WIDTH;
+
+    if(shiftSize<0) {
+        tmpMant >>= -shiftSize;
+        shiftSize = 0;
+    }
+
+    // make room for another addition
+    if(accu.pending >= C_FP32_CS_MAX_PENDING)
+        pcsCsResolve(accu);
+
+    const int32_t  off   = shiftSize / C_FP32_CS_SEG_LEN;
+    const uint32_t sh    = shiftSize % C_FP32_CS_SEG_LEN;
+    const uint64_t lower = tmpMant << sh;
+    const uint64_t upper = sh ? (tmpMant >> (64-sh)) : 0ULL;
+
+    // (x ^ m) - m negates x if m is all ones, and keeps it otherwise
+    const int64_t signMask = sign ? -1LL : 0LL;
+
+    accu.w[off]   += ((int64_t)(lower & 0xFFFFFFFFULL) ^ signMask) - signMask;
+    accu.w[off+1] += ((int64_t)(lower >> 32)           ^ signMask) - signMask;
+    accu.w[off+2] += ((int64_t)upper                   ^ signMask) - signMask;
+    accu.pending++;
+}
+
+void pcsCsResolve (fp32_csAccuType & accu)
+{
+    const int64_t segMask = (1LL << C_FP32_CS_SEG_LEN) - 1;
+    int64_t carry = 0;
+
+    // note: carries out of the top segment are dropped, they are above the
+    // overflow guard bits anyway
+    for(int32_t k = 0; k<C_FP32_CS_N_SEGS; k++) {
+        const int64_t tmp = accu.w[k] + carry;
+        accu.w[k] = tmp & segMask;
+        carry     = tmp >> C_FP32_CS_SEG_LEN;
+    }
+
+    accu.pending = 0;
+}
+
+void pcsToCs (const fp32_accuType   & input,
+                    fp32_csAccuType & output)
+{
+    static_assert(C_FP32_CS_N_SEGS * C_FP32_CS_SEG_LEN == C_FP32_N_ACCU_WORDS * 64,
+                  "pcsToCs expects two segments per accumulator word");
+
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        output.w[2*k]   = (int64_t)(input.word(k) & 0xFFFFFFFFULL);
+        output.w[2*k+1] = (int64_t)(input.word(k) >> 32);
+    }
+
+    output.pending = 0;
+}
+
+void csToPcs (const fp32_csAccuType & input,
+                    fp32_accuType   & output)
+{
+    const int64_t segMask = (1LL << C_FP32_CS_SEG_LEN) - 1;
+    int64_t carry = 0;
+
+    // resolve the carries on the fly, two segments per word
+    output = fp32_accuType();
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        const int64_t lower = input.w[2*k]   + carry;
+        const int64_t upper = input.w[2*k+1] + (lower >> C_FP32_CS_SEG_LEN);
+        output.w[k] = (uint64_t)(lower & segMask) | ((uint64_t)upper << C_FP32_CS_SEG_LEN);
+        carry       = upper >> C_FP32_CS_SEG_LEN;
+    }
+
+    output.w[C_FP32_N_ACCU_WORDS-1] = pcsMaskOflow(output.w[C_FP32_N_ACCU_WORDS-1]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// exponent binned accumulator
+///////////////////////////////////////////////////////////////////////////////
+
+// adds the extended multiplier output to its bin. the cut at the bottom and
+// the saturation behave exactly like in extFp32ToPcs, i.e. the products
+// below C_FP32_BIN_LO are cut into the lowest bin.
+static inline void extFp32AddBin (const bool         sign,
+                                  const int32_t      exponent,
+                                  const uint64_t     mantissa,
+                                  fp32_binAccuType & accu)
+{
+    int32_t  tmpExp  = exponent;
+    uint64_t tmpMant = mantissa;
+
+    if(tmpExp < C_FP32_BIN_LO || tmpExp >= C_FP32_EXP_MASK_ALIGNED) {
+        if(tmpExp < 0) {
+            return;
+        } else if(tmpExp >= C_FP32_EXP_MASK_ALIGNED) {
+            // models the same behavior as HW
+            tmpExp = C_FP32_EXP_MASK_ALIGNED;
+            tmpMant = (1ULL << (C_FP32_MANT_WIDTH*2));
+        } else {
+            tmpMant >>= C_FP32_BIN_LO - tmpExp;
+            tmpExp = C_FP32_BIN_LO;
+        }
+    }
+
+    const int32_t k        = tmpExp - C_FP32_BIN_LO;
+    const int64_t signMask = sign ? -1LL : 0LL;
+
+    accu.w[k] += ((int64_t)tmpMant ^ signMask) - signMask;
+    accu.lo    = std::min(accu.lo, k);
+    accu.hi    = std::max(accu.hi, k);
+}
+
+void pcsBinResolve (fp32_binAccuType & accu)
+{
+    static_assert((C_FP32_N_BINS-1) / C_FP32_CS_SEG_LEN + 2 < C_FP32_CS_N_SEGS,
+                  "pcsBinResolve expects room for three segments above each bin");
+
+    const int64_t segMask = (1LL << C_FP32_CS_SEG_LEN) - 1;
+
+    // the bins hold less than 2^63 in magnitude, so that the shifted value
+    // spans at most three segments, like a single product
+    for(int32_t k = accu.lo; k<=accu.hi; k++) {
+        if(!accu.w[k])
+            continue;
+
+        if(accu.cs.pending >= C_FP32_CS_MAX_PENDING - 2)
+            pcsCsResolve(accu.cs);
+
+        const int64_t  signMask = (accu.w[k] < 0) ? -1LL : 0LL;
+        const uint64_t mag      = (uint64_t)((accu.w[k] ^ signMask) - signMask);
+        const int32_t  off      = k / C_FP32_CS_SEG_LEN;
+        const uint32_t sh       = k % C_FP32_CS_SEG_LEN;
+        const uint64_t lower    = mag << sh;
+        const uint64_t upper    = sh ? (mag >> (64-sh)) : 0ULL;
+
+        accu.cs.w[off]   += ((int64_t)(lower & segMask) ^ signMask) - signMask;
+        accu.cs.w[off+1] += ((int64_t)(lower >> 32)     ^ signMask) - signMask;
+        accu.cs.w[off+2] += ((int64_t)upper             ^ signMask) - signMask;
+        accu.cs.pending += 3;
+
+        accu.w[k] = 0;
+    }
+
+    accu.pending = 0;
+    accu.lo      = C_FP32_N_BINS;
+    accu.hi      = -1;
+}
+
+template <bool accuSel, bool normEn>
+uint32_t  pcsMacT ( const uint32_t    opA,
+                    const uint32_t    opB,
+                    const uint8_t     subEn,
+                    fp32_csAccuType & accuState,
+                    uint32_t        & res)
+{
+    bool     signTmp;
+    int32_t  expTmp;
+    uint64_t mantTmp;
+
+    NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_CALL, accuSel | (subEn<<1) | (normEn<<2), opA, opB, &accuState);
+
+    // multiplication
+    fp32Mult(opA, opB, signTmp, expTmp, mantTmp);
+
+    NTX_TRACE_WORDS(C_NTX_TRACE_PCS_MAC_MULT, 0, signTmp, expTmp, mantTmp, 0, 0);
+
+    // use operand C if this is set
+    if(accuSel)
+        accuState.clear();
+
+    extFp32AddCs(signTmp ^ (bool)subEn, expTmp, mantTmp, accuState);
+
+    NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_ACCU, 0, 0, 0, &accuState);
+
+    // resolve the carries only if needed
+    if(normEn) {
+        fp32_accuType tmp;
+        csToPcs(accuState, tmp);
+        pcsToFp32(tmp, res);
+        NTX_TRACE_PCS(C_NTX_TRACE_PCS_MAC_NORM, 0, res, 0, (const fp32_accuType *)nullptr);
+    }
+
+    return 0;
+}
+
+template uint32_t pcsMacT<false, false> (const uint32_t, const uint32_t, const uint8_t, fp32_csAccuType &, uint32_t &);
+template uint32_t pcsMacT<false, true > (const uint32_t, const uint32_t, const uint8_t, fp32_csAccuType &, uint32_t &);
+template uint32_t pcsMacT<true,  false> (const uint32_t, const uint32_t, const uint8_t, fp32_csAccuType &, uint32_t &);
+template uint32_t pcsMacT<true,  true > (const uint32_t, const uint32_t, const uint8_t, fp32_csAccuType &, uint32_t &);
+
+uint32_t  pcsMacCs ( const uint32_t    opA,
+                     const uint32_t    opB,
+                     const uint8_t     accuSel,
+                     const uint8_t     subEn,
+                     const uint8_t     normEn,
+                     fp32_csAccuType & accuState,
+                     uint32_t        & res)
+{
+    if(accuSel)
+        return normEn ? pcsMacT<true,  true >(opA, opB, subEn, accuState, res) :
+                        pcsMacT<true,  false>(opA, opB, subEn, accuState, res);
+    else
+        return normEn ? pcsMacT<false, true >(opA, opB, subEn, accuState, res) :
+                        pcsMacT<false, false>(opA, opB, subEn, accuState, res);
+}
+
+void pcsMacDot (const uint32_t  * a,
+                const int32_t     strideA,
+                const uint32_t  * b,
+                const int32_t     strideB,
+                const uint32_t    n,
+                const uint8_t     subEn,
+                fp32_csAccuType & accuState)
+{
+    const char * ptrA = (const char *)a;
+    const char * ptrB = (const char *)b;
+
+    bool     signTmp;
+    int32_t  expTmp;
+    uint64_t mantTmp;
+
+    // work on a local copy, which the compiler does not need to write back
+    // after every element
+    fp32_csAccuType accu = accuState;
+
+    for(uint32_t k = 0; k<n; k++) {
+        fp32Mult(*(const uint32_t *)ptrA, *(const uint32_t *)ptrB, signTmp, expTmp, mantTmp);
+        extFp32AddCs(signTmp ^ (bool)subEn, expTmp, mantTmp, accu);
+        ptrA += strideA;
+        ptrB += strideB;
+    }
+
+    accuState = accu;
+}
+
+void pcsMacDotParallel (const uint32_t * a,
+                        const int32_t    strideA,
+                        const uint32_t * b,
+                        const int32_t    strideB,
+                        const uint32_t   n,
+                        const uint8_t    subEn,
+                        uint32_t         nChunks,
+                        fp32_jobRunType  run,
+                        fp32_accuType  & accuState)
+{
+    nChunks = std::max(1U, std::min(std::min(nChunks, (uint32_t)C_FP32_PAR_MAX_CHUNKS), n / C_FP32_PAR_MIN_CHUNK));
+
+    fp32_csAccuType partial[C_FP32_PAR_MAX_CHUNKS];
+
+    // chunk t has n / nChunks elements, plus one for the first n % nChunks
+    // chunks
+    auto chunk = [&](uint32_t t) {
+        const uint32_t start = n / nChunks * t + std::min(t, n % nChunks);
+        const uint32_t len   = n / nChunks + (n % nChunks > t);
+        pcsMacDot((const uint32_t *)((const char *)a + (int64_t)start * strideA), strideA,
+                  (const uint32_t *)((const char *)b + (int64_t)start * strideB), strideB,
+                  len, subEn, partial[t]);
+    };
+
+    if(run && nChunks > 1) {
+        run(nChunks, [](void * ctx, uint32_t t) { (*(decltype(chunk) *)ctx)(t); }, &chunk);
+    } else {
+        for(uint32_t t = 0; t<nChunks; t++)
+            chunk(t);
+    }
+
+    // merge the partial sums, the order does not matter
+    fp32_accuType tmp;
+    for(uint32_t t = 0; t<nChunks; t++) {
+        csToPcs(partial[t], tmp);
+        pcsAdd(tmp, accuState, accuState);
+    }
+}
+
+void pcsMacDotTile (const uint32_t   * a,
+                    const int32_t      strideA,
+                    const int32_t      tileStrideA,
+                    const uint32_t   * b,
+                    const int32_t      strideB,
+                    const int32_t      tileStrideB,
+                    const uint32_t     n,
+                    const uint32_t     nTile,
+                    const uint8_t      subEn,
+                    fp32_binAccuType * accu)
+{
+    const char * ptrA = (const char *)a;
+    const char * ptrB = (const char *)b;
+
+    bool     signTmp;
+    int32_t  expTmp;
+    uint64_t mantTmp;
+
+    uint32_t k = 0;
+    while(k < n) {
+        // process as many elements as the bins of all accumulators have
+        // headroom for
+        uint32_t len = n - k;
+        for(uint32_t t = 0; t<nTile; t++) {
+            if(accu[t].pending >= C_FP32_BIN_MAX_PENDING)
+                pcsBinResolve(accu[t]);
+            len = std::min(len, C_FP32_BIN_MAX_PENDING - accu[t].pending);
+        }
+
+        for(uint32_t j = 0; j<len; j++) {
+            const char * tileA = ptrA;
+            const char * tileB = ptrB;
+            for(uint32_t t = 0; t<nTile; t++) {
+                fp32Mult(*(const uint32_t *)tileA, *(const uint32_t *)tileB, signTmp, expTmp, mantTmp);
+                extFp32AddBin(signTmp ^ (bool)subEn, expTmp, mantTmp, accu[t]);
+                tileA += tileStrideA;
+                tileB += tileStrideB;
+            }
+            ptrA += strideA;
+            ptrB += strideB;
+        }
+
+        for(uint32_t t = 0; t<nTile; t++)
+            accu[t].pending += len;
+        k += len;
+    }
+}
@@ -18,8 +18,7 @@
 #include <cstdint>
 #include <cstddef>
 
-// enables some debug output
-// #define FP32_DEBUG_ON
+// trace points are enabled with NTX_TRACE_ON, see ntx_trace.hpp
 // #define WIN64
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -43,6 +42,26 @@
 #define C_FP32_BIAS                  127
 #define C_FP32_PCS_WIDTH             (1 + (1<<C_FP32_EXP_WIDTH) + C_FP32_MANT_WIDTH + C_FP32_N_ACCU_OFLOW_BITS)
 
+// carry chain implementations of pcsAdd and pcsInv, see pcsSetBackend
+#define C_FP32_PCS_BACKEND_REF       0 // compare-and-branch carry detection
+#define C_FP32_PCS_BACKEND_PORTABLE  1 // __builtin_addcll or unsigned __int128
+#define C_FP32_PCS_BACKEND_ADX       2 // x86 ADX add-with-carry instructions
+
+// deferred carry accumulator, see fp32_csAccuType
+#define C_FP32_CS_SEG_LEN            32 // value bits per segment
+#define C_FP32_CS_N_SEGS             10 // covers the pcs width plus one spare segment
+#define C_FP32_CS_MAX_PENDING        (1U<<30) // additions before the carries have to be resolved
+
+// exponent binned accumulator, see fp32_binAccuType
+#define C_FP32_BIN_LO                C_FP32_MANT_WIDTH // exponent of the lowest bin, smaller products are cut into it
+#define C_FP32_N_BINS                (C_FP32_EXP_MASK_ALIGNED - C_FP32_BIN_LO + 1)
+#define C_FP32_BIN_MAX_PENDING       (1U<<15) // products before the bins have to be folded
+
+// minimum number of elements per chunk, and maximum number of chunks of
+// pcsMacDotParallel
+#define C_FP32_PAR_MIN_CHUNK         4096
+#define C_FP32_PAR_MAX_CHUNKS        64
+
 ///////////////////////////////////////////////////////////////////////////////
 // internal helper datatypes
 ///////////////////////////////////////////////////////////////////////////////
@@ -106,7 +125,108 @@ template <typename T, size_t D1, size_t D2> class arr2D
 // accumulator is implemented using partial carry save arithmetic in HW.
 // note however, that we do not use carry save arithmetic in this emulation -
 // we just have to split the overlong 280bit word into several subwords...
-typedef arr1D<uint64_t, C_FP32_N_ACCU_WORDS> fp32_accuType;
+//
+// most products only touch one or two of these words. the functions in
+// fp32_mac.cpp therefore track the live window [lo, hi] of their temporary
+// accumulators: words below lo are zero, words above hi are the sign
+// extension given by neg, and neither is kept up to date in w[]. all
+// accumulators that are passed to or returned from these functions have the
+// full window though (lo = 0, hi = top word), so w[] can be read and written
+// directly, like in a default constructed or cleared accumulator.
+class fp32_accuType : public arr1D<uint64_t, C_FP32_N_ACCU_WORDS>
+{
+    public:
+    int32_t lo  = 0;
+    int32_t hi  = C_FP32_N_ACCU_WORDS-1;
+    bool    neg = false;
+
+    using arr1D::arr1D;
+    fp32_accuType() {}
+
+    // sign of the accumulated value
+    bool isNeg() const {
+        if(hi >= C_FP32_N_ACCU_WORDS-1)
+            return (lo <= hi) && (w[C_FP32_N_ACCU_WORDS-1] >> 63);
+        return neg;
+    }
+
+    // value of accumulator word k, also outside of the live window
+    uint64_t word(int32_t k) const {
+        return (k > hi) ? (neg ? ~0ULL : 0ULL) : ((k < lo) ? 0ULL : w[k]);
+    }
+
+    // materialize all words in w[] and open the window to full width
+    void expand() {
+        for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+            w[k] = word(k);
+        neg = isNeg();
+        lo  = 0;
+        hi  = C_FP32_N_ACCU_WORDS-1;
+    }
+
+    void clear() {
+        arr1D::clear();
+        lo  = 0;
+        hi  = C_FP32_N_ACCU_WORDS-1;
+        neg = false;
+    }
+
+    void set(const fp32_accuType & other) {
+        *this = other;
+    }
+};
+
+// deferred carry version of the accumulator, similar to the partial carry
+// save arithmetic of fp32_pcsAdd.vhd. the value is split into segments of
+// C_FP32_CS_SEG_LEN bits, and each segment is kept in a signed 64bit word.
+// the upper bits of these words collect the carries (and borrows) of all
+// additions into the segment, which are only propagated to the next segment
+// when the value is needed (pcsCsResolve) or when the headroom is used up
+// after C_FP32_CS_MAX_PENDING additions. the value of the accumulator is
+// sum(w[k] << k*C_FP32_CS_SEG_LEN), truncated to C_FP32_PCS_WIDTH bits.
+class fp32_csAccuType : public arr1D<int64_t, C_FP32_CS_N_SEGS>
+{
+    public:
+    uint32_t pending = 0;
+
+    using arr1D::arr1D;
+    fp32_csAccuType() {}
+
+    void clear() {
+        arr1D::clear();
+        pending = 0;
+    }
+
+    void set(const fp32_csAccuType & other) {
+        *this = other;
+    }
+};
+
+// exponent binned accumulator for long dot products. a product with
+// exponent e is aligned at bit e - C_FP32_BIN_LO of the pcs format, so it is
+// simply added to bin w[e - C_FP32_BIN_LO] as a signed integer, without
+// any shifting. the bins are folded into the deferred carry accumulator cs
+// when the value is needed (pcsBinResolve) or when the headroom is used up
+// after C_FP32_BIN_MAX_PENDING products. the value of the accumulator is
+// cs + sum(w[k] << k). [lo, hi] is the range of bins that may be non-zero.
+class fp32_binAccuType : public arr1D<int64_t, C_FP32_N_BINS>
+{
+    public:
+    fp32_csAccuType cs;
+    uint32_t pending = 0;
+    int32_t  lo      = C_FP32_N_BINS;
+    int32_t  hi      = -1;
+
+    fp32_binAccuType() {}
+
+    void clear() {
+        arr1D::clear();
+        cs.clear();
+        pending = 0;
+        lo      = C_FP32_N_BINS;
+        hi      = -1;
+    }
+};
 typedef uint32_t fp32;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -121,6 +241,86 @@ extern "C" uint32_t pcsMac (const uint32_t    opA,
                             fp32_accuType   & accuState,
                                   uint32_t  & res);
 
+// same as pcsMac, but operates on a deferred carry accumulator. the results
+// are bit-true to pcsMac, but the carries are only propagated when
+// normalizing, which makes long accumulation chains cheaper.
+extern "C" uint32_t pcsMacCs (const uint32_t    opA,
+                              const uint32_t    opB,
+                              const uint8_t     accuSel,
+                              const uint8_t     subEn,
+                              const uint8_t     normEn,
+                              fp32_csAccuType & accuState,
+                                    uint32_t  & res);
+
+// variants of pcsMac and pcsMacCs with accuSel and normEn fixed at compile
+// time, so that the per element path does not carry the branches and the
+// normalization code it does not need. instantiated for all four
+// combinations in fp32_mac.cpp.
+template <bool accuSel, bool normEn>
+uint32_t pcsMacT (const uint32_t    opA,
+                  const uint32_t    opB,
+                  const uint8_t     subEn,
+                  fp32_accuType   & accuState,
+                  uint32_t        & res);
+
+template <bool accuSel, bool normEn>
+uint32_t pcsMacT (const uint32_t    opA,
+                  const uint32_t    opB,
+                  const uint8_t     subEn,
+                  fp32_csAccuType & accuState,
+                  uint32_t        & res);
+
+// accumulates the dot product of two strided fp32 vectors with n elements
+// into a deferred carry accumulator. this is bit-true to n calls of
+// pcsMacCs with accuSel = normEn = 0, but avoids the per element call
+// overhead. the strides are given in bytes (like the AGU strides) and may
+// be zero or negative.
+extern "C" void pcsMacDot (const uint32_t  * a,
+                           const int32_t     strideA,
+                           const uint32_t  * b,
+                           const int32_t     strideB,
+                           const uint32_t    n,
+                           const uint8_t     subEn,
+                           fp32_csAccuType & accuState);
+
+// runs fn(ctx, k) for k = 0..n-1, on as many threads as it likes, and
+// returns when all calls are done. the emulator passes the runner of its
+// thread pool (ntxPoolRun in ntx_pool.hpp).
+typedef void (*fp32_jobRunType)(uint32_t n, void (*fn)(void *, uint32_t), void * ctx);
+
+// parallel version of pcsMacDot. the vectors are split into nChunks
+// contiguous chunks which are accumulated by the jobs of run into their own
+// accumulators. the partial sums are merged with pcsAdd, which is exact, so
+// the result is bit-true to the sequential version. short vectors use fewer
+// chunks (see C_FP32_PAR_MIN_CHUNK), and nChunks = 0 or a null run
+// accumulate on the calling thread.
+extern "C" void pcsMacDotParallel (const uint32_t * a,
+                                   const int32_t    strideA,
+                                   const uint32_t * b,
+                                   const int32_t    strideB,
+                                   const uint32_t   n,
+                                   const uint8_t    subEn,
+                                   const uint32_t   nChunks,
+                                   fp32_jobRunType  run,
+                                   fp32_accuType  & accuState);
+
+// accumulates nTile dot products of two strided fp32 vectors with n elements
+// each into the binned accumulators accu[0..nTile-1]. the vectors of dot
+// product t start at a + t*tileStrideA and b + t*tileStrideB. the elements
+// are processed in order, and all dot products of the tile at once, so that
+// operands which are shared or adjacent between the dot products of a tile
+// are only fetched once. this is bit-true to n calls of pcsMacCs with
+// accuSel = normEn = 0 per dot product. all strides are given in bytes.
+extern "C" void pcsMacDotTile (const uint32_t   * a,
+                               const int32_t      strideA,
+                               const int32_t      tileStrideA,
+                               const uint32_t   * b,
+                               const int32_t      strideB,
+                               const int32_t      tileStrideB,
+                               const uint32_t     n,
+                               const uint32_t     nTile,
+                               const uint8_t      subEn,
+                               fp32_binAccuType * accu);
 
 ///////////////////////////////////////////////////////////////////////////////
 // some helper functions
@@ -176,6 +376,38 @@ fp32 inline floatTofp32(float in)
     return tmp.i;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// single product, normalized to fp32. this is bit-true to pcsMac with
+// accuSel = normEn = 1, but derives the truncated result directly from the
+// 2.46 bit multiplier output instead of going through the accumulator.
+///////////////////////////////////////////////////////////////////////////////
+fp32 inline pcsMul(const fp32 opA, const fp32 opB, const uint8_t subEn)
+{
+    if(fp32_isZero(opA) || fp32_isZero(opB))
+        return C_FP32_ZERO_VAL;
+
+    const int32_t  exponent = fp32_getExp(opA) + fp32_getExp(opB) - C_FP32_BIAS;
+    const uint64_t mantissa = ((uint64_t) fp32_getMantFull(opA)) *
+                              ((uint64_t) fp32_getMantFull(opB));
+    const fp32     sign     = ((opA ^ opB) & C_FP32_SIGN_MASK) ^ (subEn ? C_FP32_SIGN_MASK : 0);
+
+    // products below the accumulator range are cut away (-> +0)
+    if(exponent < 0)
+        return C_FP32_ZERO_VAL;
+
+    // the mantissa product is in [1,4), i.e. the leading one is either at
+    // bit 46 or at bit 47. this also covers the saturation of the
+    // multiplier output at the maximum exponent.
+    const uint32_t carry  = (uint32_t)(mantissa >> (2*C_FP32_MANT_WIDTH+1));
+    const int32_t  tmpExp = exponent + carry;
+
+    if(tmpExp >= C_FP32_EXP_MASK_ALIGNED)
+        return sign | C_FP32_INF_VAL;
+
+    return sign | ((fp32)tmpExp << C_FP32_MANT_WIDTH) |
+           ((fp32)(mantissa >> (C_FP32_MANT_WIDTH + carry)) & C_FP32_MANT_MASK);
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // sign inversion of the accumulator
@@ -208,9 +440,52 @@ void fp32ToPcs (const    fp32  & input,
 void pcsToFp32 (const fp32_accuType & input,
                 fp32                & output);
 
+///////////////////////////////////////////////////////////////////////////////
+// backwards conversion of n accumulators at once. uses AVX-512 if the host
+// supports it, and is bit-true to pcsToFp32 in any case.
+///////////////////////////////////////////////////////////////////////////////
+void pcsToFp32Batch (const fp32_accuType * input,
+                           fp32          * output,
+                     const uint32_t        n);
+
+///////////////////////////////////////////////////////////////////////////////
+// selection of the AVX-512 version of pcsToFp32Batch, which is used by
+// default if the host supports it. pcsSetBatchAvx512(false) selects the
+// portable version, and pcsSetBatchAvx512(true) returns false and leaves the
+// current selection untouched if AVX-512 is not available.
+///////////////////////////////////////////////////////////////////////////////
+bool pcsHasBatchAvx512 ();
+bool pcsSetBatchAvx512 (const bool enable);
+
 ///////////////////////////////////////////////////////////////////////////////
 // addition routine on accumulator datatypes
 ///////////////////////////////////////////////////////////////////////////////
 void pcsAdd (const fp32_accuType & opA,
              const fp32_accuType & opB,
                    fp32_accuType & out);
+
+///////////////////////////////////////////////////////////////////////////////
+// selection of the carry chain backend used by pcsAdd and pcsInv. the
+// fastest backend supported by the host CPU is selected at startup, all
+// backends are bit-true to each other. pcsSetBackend returns false and
+// leaves the current selection untouched if the backend is not available.
+///////////////////////////////////////////////////////////////////////////////
+bool     pcsHasBackend (const uint32_t backend);
+bool     pcsSetBackend (const uint32_t backend);
+uint32_t pcsGetBackend ();
+
+///////////////////////////////////////////////////////////////////////////////
+// deferred carry accumulator. pcsCsResolve propagates all pending carries
+// in place, the other two functions convert from and to the pcs format.
+///////////////////////////////////////////////////////////////////////////////
+void pcsCsResolve (fp32_csAccuType & accu);
+
+void pcsToCs (const fp32_accuType   & input,
+                    fp32_csAccuType & output);
+
+void csToPcs (const fp32_csAccuType & input,
+                    fp32_accuType   & output);
+
+// folds the bins of a binned accumulator into its deferred carry accumulator
+// accu.cs, and leaves the bins cleared
+void pcsBinResolve (fp32_binAccuType & accu);
@@ -19,12 +19,14 @@
 #include <math.h>
 #include <inttypes.h>
 #include <cassert>
-#include <functional>
 
 #define NTX_EMULATION_ON
 
 #include "ntx_api.hpp"
 #include "fp32_mac.hpp"
+#include "ntx_trace.hpp"
+#include "ntx_pool.hpp"
+#include "ntx_cluster.hpp"
 
 
 #ifdef NTX_EMULATION_ON
@@ -33,7 +35,23 @@
 // definition of internal emulation functions
 ///////////////////////////////////////////////////////////////////////////////
 
+// trace point of the command executed by an op, see ntx_trace.hpp
+#define NTX_TRACE_CMD(point, flags, arg0, arg1, arg2)                               \
+    NTX_TRACE_OP((point), ntx->opCode, (flags),                                     \
+                 ntx->initSel | ((uint32_t)ntx->polarity<<8) | ((uint32_t)ntx->auxFunc<<16), \
+                 &ntx->agu.w[0], (arg0), (arg1), (arg2))
+
+// operand of the vectorized row kernels: a contiguous vector (vec), or a
+// constant that is read once
+struct nstRowSrc {
+    const uint32_t * ptr;
+    bool             vec;
+};
 
+// the ops are plain classes without virtual functions. each combination of
+// opcode and aux function is a separate instantiation (see nstKernelSel
+// below), so that the aux modes are resolved at compile time, and the loop
+// nest in nstLoop calls init/execute/store directly.
 class nstInternalOp {
     public:
     ntx_api * ntx;
@@ -42,81 +60,735 @@ class nstInternalOp {
         ntx = nst_;
     }
 
-    virtual void init() = 0;
-    virtual void execute() = 0;
-    virtual void store() = 0;
+    // for arrays of ops, see nstLoop
+    nstInternalOp() : ntx(nullptr) {
+    }
+
+    // processes all n iterations of the innermost loop at once, including
+    // init and store if they happen inside of that loop. returns false if the
+    // op does not support this (for the current loop configuration), and the
+    // looper falls back to calling init/execute/store per iteration. ops
+    // that support this hide this default.
+    bool executeRow(uint32_t n) {
+        return false;
+    }
+
+    // processes the whole loop nest at once. returns false if the op does
+    // not support this (for the current loop configuration), and the looper
+    // falls back to the generic loop nest. ops that support this hide this
+    // default.
+    bool executeNest() {
+        return false;
+    }
+
+    // true if the iterations of a row of length n may be processed in chunks,
+    // i.e. if none of the stores through agu2 feeds the load of a later
+    // iteration. this is the case if the address ranges are disjoint, or if
+    // the result is written exactly in place.
+    bool rowIsAliasFree(uint32_t n);
+
+    // normalizes n accumulators, applies the ReLu if enabled, and stores the
+    // results through agu2, starting at res.
+    template <bool RELU>
+    void storeRow(const fp32_accuType * acc, uint32_t n, char *& res);
+
+    // operand of AGU o in a row, for the vectorized row kernels. returns
+    // false if the AGU is neither contiguous nor constant in the row.
+    bool rowSrc(uint32_t o, nstRowSrc & src);
+
+    // value of aluState in a row. it is reloaded in every iteration if
+    // init is in the innermost loop, in which case rowAluLatch leaves the
+    // value of the last iteration behind. it must be called before the row
+    // is stored, as the stores may overwrite the operands in place.
+    bool rowAluSrc(nstRowSrc & src);
+    void rowAluLatch(const nstRowSrc & src, uint32_t n);
+
+    // runs the loop nest of an op whose executes only overwrite the state
+    // that is stored, such that all but the last execute of a window (the
+    // levels below innerLevel) are dead. calls init, the last execute and
+    // store once per output. counts is set if execute increments
+    // cntState. returns false if the nest stores in every iteration.
+    template <class OP>
+    bool executeLastIters(OP & op, bool counts);
 
 };
 
+// for MAC, VADDSUB, VMULT and OUTERP
+template <bool RELU>
 struct nstMacOp : nstInternalOp{
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
+    bool executeNest();
 };
 
+template <bool RELU>
 struct nstVAddSubOp : nstInternalOp{
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
 };
 
+template <bool RELU>
 struct nstVMultOp : nstInternalOp{
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
 };
 
+template <bool RELU>
 struct nstOuterPOp : nstInternalOp{
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
 };
 
+template <bool ARG>
 struct nstMaxMinOp : nstInternalOp{
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
 };
 
+template <uint8_t AUX>
 struct nstThTstOp : nstInternalOp{
     bool tst;
     uint32_t *opB;
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
+    bool executeNest();
 };
 
+template <uint8_t AUX>
 struct nstMaskOp : nstInternalOp{
     bool tst;
     uint32_t *opA;
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
+    bool executeNest();
 };
 
+template <uint8_t AUX>
 struct nstMaskMacOp : nstInternalOp{
     bool tst;
     uint32_t *opA;
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
 };
 
+template <bool VECT>
 struct nstCopyOp : nstInternalOp{
     using nstInternalOp::nstInternalOp;
-    virtual void init();
-    virtual void execute();
-    virtual void store();
+    void init();
+    void execute();
+    void store();
+    bool executeRow(uint32_t n);
+    bool executeNest();
 };
 
+// comparison of THTST, MASK and MASKMAC, see C_NTX_THTST_AUX_* and
+// C_NTX_MASK_AUX_*. invalid modes never pass.
+template <uint8_t CMP>
+static inline bool
+nstCompare(const ntx_api * ntx, const uint32_t opB) {
+    bool tst;
+    switch(CMP) {
+        case C_NTX_THTST_AUX_CMP_EQ:
+            tst = (fp32ToFloat(ntx->aluState) == fp32ToFloat(opB));
+            break;
+        case C_NTX_MASK_AUX_CMP_LT:
+            tst = (fp32ToFloat(ntx->aluState) > fp32ToFloat(opB));
+            break;
+        case C_NTX_THTST_AUX_CMP_LE:
+            tst = (fp32ToFloat(ntx->aluState) >= fp32ToFloat(opB));
+            break;
+        case C_NTX_MASK_AUX_CMP_CNT:
+            // compare with counter
+            tst = ntx->cntState == ntx->aluState;
+            break;
+        default:
+            return false;
+    }
+    // invert if necessary
+    return tst ^ ntx->polarity;
+}
+
+// number of elements that are normalized in one batch by the element-wise
+// ops, see nstInternalOp::storeRow
+#define C_NTX_ROW_CHUNK 64
+
+// number of outputs that are accumulated at the same time by the MAC nest
+// kernel, see nstMacOp::executeNest
+#define C_NTX_MAC_TILE 4
+
+// maximum number of broadcast members that share one loop control, see
+// nstLoop. larger groups thrash the op state of the members.
+#define C_NTX_SHARED_LOOP_MAX 4
+
+// edge of the tiles of strided 2D copies, see nstCopyTransposed
+#define C_NTX_COPY_TILE 32
+
+// minimum number of innermost iterations of a command that is split across
+// the thread pool, see nstRunParallel
+#define C_NTX_PAR_MIN_ITERS (1 << 14)
+
+bool
+nstInternalOp::rowIsAliasFree(uint32_t n) {
+
+    const char *   res       = (const char *)ntx->agu[2];
+    const int32_t  resStride = ntx->aguStride[2][0];
+    const char *   resLo     = std::min(res, res + (int64_t)resStride * (n-1));
+    const char *   resHi     = std::max(res, res + (int64_t)resStride * (n-1)) + sizeof(uint32_t);
+
+    // the operands are read through agu0/agu1, and through agu2 if it is
+    // used to init in every iteration
+    const uint32_t nLoads = (ntx->initLevel == 0 && ntx->initSel == 2) ? 3 : 2;
+
+    for(uint32_t o=0; o < nLoads; o++) {
+        const char *  op       = (const char *)ntx->agu[o];
+        const int32_t opStride = ntx->aguStride[o][0];
+        const char *  opLo     = std::min(op, op + (int64_t)opStride * (n-1));
+        const char *  opHi     = std::max(op, op + (int64_t)opStride * (n-1)) + sizeof(uint32_t);
+
+        const bool inPlace  = (op == res) && (opStride == resStride) &&
+                              (std::abs(opStride) >= (int32_t)sizeof(uint32_t));
+        const bool disjoint = (opHi <= resLo) || (resHi <= opLo);
+
+        if(!inPlace && !disjoint && n > 1)
+            return false;
+    }
+
+    return true;
+}
+
+template <bool RELU>
+void
+nstInternalOp::storeRow(const fp32_accuType * acc, uint32_t n, char *& res) {
+
+    uint32_t tmp[C_NTX_ROW_CHUNK];
+
+    // call the bittrue model
+    pcsToFp32Batch(acc, tmp, n);
+
+    for(uint32_t k=0; k<n; k++) {
+        // apply ReLu if required
+        if(RELU && fp32_getSign(tmp[k])) {
+            tmp[k] = C_FP32_ZERO_VAL;
+        }
+
+        *(uint32_t *)res = tmp[k];
+        res += ntx->aguStride[2][0];
+    }
+}
+
+bool
+nstInternalOp::rowSrc(uint32_t o, nstRowSrc & src) {
+
+    src.ptr = (const uint32_t *)ntx->agu[o];
+    src.vec = ntx->aguStride[o][0] != 0;
+
+    return ntx->aguStride[o][0] == 0 || ntx->aguStride[o][0] == sizeof(uint32_t);
+}
+
+bool
+nstInternalOp::rowAluSrc(nstRowSrc & src) {
+
+    static const uint32_t zero = C_FP32_ZERO_VAL;
+
+    src.ptr = &ntx->aluState;
+    src.vec = false;
+
+    if(ntx->initLevel > 0)
+        return true;
+    if(ntx->initSel >= 3) {
+        src.ptr = &zero;
+        return true;
+    }
+    return rowSrc(ntx->initSel, src);
+}
+
+void
+nstInternalOp::rowAluLatch(const nstRowSrc & src, uint32_t n) {
+
+    if(ntx->initLevel == 0)
+        ntx->aluState = src.ptr[src.vec ? n-1 : 0];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vectorized row kernels of MAXMIN, THTST, MASK and COPY. they are written
+// with the generic vector extension of GCC/clang, and instantiated for 4
+// lanes (SSE, or the baseline of other hosts) and 8 lanes (AVX2, selected at
+// startup if the host supports it). the float comparisons have the same
+// semantics as the scalar ones, including NaNs and signed zeros.
+///////////////////////////////////////////////////////////////////////////////
+
+template <uint32_t N>
+struct nstVec {
+    typedef uint32_t u32 __attribute__((vector_size(4*N)));
+    typedef int32_t  i32 __attribute__((vector_size(4*N)));
+    typedef float    f32 __attribute__((vector_size(4*N)));
+};
+
+// mode of nstSelectRow that never passes, like the invalid modes of
+// nstCompare
+#define C_NTX_ROW_CMP_NEVER 3
+
+// res[k] = tst[k] ? x[k] : y[k] for a contiguous row of n results, where
+// tst[k] is nstCompare<cmp> of a[k] against b[k] (or against the counter
+// cnt + k (cntVec) or cnt), see nstCompare.
+struct nstSelectRow {
+    nstRowSrc  a;
+    nstRowSrc  b;
+    nstRowSrc  x;
+    nstRowSrc  y;
+    uint32_t * res;
+    uint32_t   n;
+    uint8_t    cmp;
+    bool       polarity;
+    uint32_t   cnt;
+    bool       cntVec;
+};
+
+template <uint8_t CMP>
+static inline __attribute__((always_inline)) uint32_t
+nstSelectOne(const nstSelectRow & r, uint32_t k) {
+
+    const uint32_t a   = r.a.ptr[r.a.vec ? k : 0];
+    const uint32_t cnt = r.cnt + (r.cntVec ? k : 0);
+    bool tst;
+    switch(CMP) {
+        case C_NTX_MASK_AUX_CMP_EQ:
+            tst = (fp32ToFloat(a) == fp32ToFloat(r.b.ptr[r.b.vec ? k : 0]));
+            break;
+        case C_NTX_MASK_AUX_CMP_LT:
+            tst = (fp32ToFloat(a) > fp32ToFloat(r.b.ptr[r.b.vec ? k : 0]));
+            break;
+        case C_NTX_MASK_AUX_CMP_LE:
+            tst = (fp32ToFloat(a) >= fp32ToFloat(r.b.ptr[r.b.vec ? k : 0]));
+            break;
+        case C_NTX_MASK_AUX_CMP_CNT:
+            tst = (cnt == a);
+            break;
+        default:
+            return r.y.ptr[r.y.vec ? k : 0];
+    }
+    tst ^= r.polarity;
+    return tst ? r.x.ptr[r.x.vec ? k : 0] : r.y.ptr[r.y.vec ? k : 0];
+}
+
+template <uint32_t N, uint8_t CMP>
+static inline __attribute__((always_inline)) void
+nstSelectRowT(const nstSelectRow & r) {
+
+    typedef typename nstVec<N>::u32 u32;
+    typedef typename nstVec<N>::i32 i32;
+    typedef typename nstVec<N>::f32 f32;
+
+    u32 aC, bC, xC, yC, cntV;
+    for(uint32_t j=0; j<N; j++) {
+        aC[j]   = r.a.ptr[0];
+        bC[j]   = r.b.ptr[0];
+        xC[j]   = r.x.ptr[0];
+        yC[j]   = r.y.ptr[0];
+        cntV[j] = r.cnt + (r.cntVec ? j : 0);
+    }
+
+    uint32_t k = 0;
+    for(; k+N <= r.n; k+=N) {
+        u32 a = aC, b = bC, x = xC, y = yC, res;
+        if(r.a.vec) memcpy(&a, r.a.ptr + k, sizeof(a));
+        if(r.b.vec) memcpy(&b, r.b.ptr + k, sizeof(b));
+        if(r.x.vec) memcpy(&x, r.x.ptr + k, sizeof(x));
+        if(r.y.vec) memcpy(&y, r.y.ptr + k, sizeof(y));
+
+        i32 tst;
+        switch(CMP) {
+            case C_NTX_MASK_AUX_CMP_EQ:
+                tst = ((f32)a == (f32)b);
+                break;
+            case C_NTX_MASK_AUX_CMP_LT:
+                tst = ((f32)a > (f32)b);
+                break;
+            case C_NTX_MASK_AUX_CMP_LE:
+                tst = ((f32)a >= (f32)b);
+                break;
+            case C_NTX_MASK_AUX_CMP_CNT:
+                tst = (cntV == a);
+                if(r.cntVec)
+                    cntV += N;
+                break;
+            default:
+                tst = (a != a);
+        }
+        if(r.polarity && CMP != C_NTX_ROW_CMP_NEVER)
+            tst = ~tst;
+
+        res = tst ? x : y;
+        memcpy(r.res + k, &res, sizeof(res));
+    }
+
+    for(; k < r.n; k++)
+        r.res[k] = nstSelectOne<CMP>(r, k);
+}
+
+template <uint32_t N>
+static inline __attribute__((always_inline)) void
+nstSelectRowN(const nstSelectRow & r) {
+    switch(r.cmp) {
+        case C_NTX_MASK_AUX_CMP_EQ:  nstSelectRowT<N, C_NTX_MASK_AUX_CMP_EQ>(r);  break;
+        case C_NTX_MASK_AUX_CMP_LT:  nstSelectRowT<N, C_NTX_MASK_AUX_CMP_LT>(r);  break;
+        case C_NTX_MASK_AUX_CMP_LE:  nstSelectRowT<N, C_NTX_MASK_AUX_CMP_LE>(r);  break;
+        case C_NTX_MASK_AUX_CMP_CNT: nstSelectRowT<N, C_NTX_MASK_AUX_CMP_CNT>(r); break;
+        default:                     nstSelectRowT<N, C_NTX_ROW_CMP_NEVER>(r);
+    }
+}
+
+// MAXMIN over a contiguous row of n operands b, see nstMaxMinOp::execute.
+// an operand replaces aluState if aluState > b (polarity), or if not (no
+// polarity), so the result is the first minimum or the last maximum. this is
+// computed in two passes: the extremum, and then its index. returns false
+// without touching the state if the row or aluState contain NaNs.
+template <uint32_t N>
+static inline __attribute__((always_inline)) bool
+nstMaxMinRowN(const uint32_t * b, uint32_t n, bool polarity,
+              uint32_t & alu, uint32_t & idx, uint32_t cnt) {
+
+    typedef typename nstVec<N>::u32 u32;
+    typedef typename nstVec<N>::i32 i32;
+    typedef typename nstVec<N>::f32 f32;
+
+    const float aluF = fp32ToFloat(alu);
+    if(aluF != aluF)
+        return false;
+
+    // extremum
+    float    ext = fp32ToFloat(b[0]);
+    bool     nan = false;
+    uint32_t k   = 0;
+    if(n >= N) {
+        u32 w;
+        memcpy(&w, b, sizeof(w));
+        f32 e   = (f32)w;
+        i32 bad = (e != e);
+        for(k=N; k+N <= n; k+=N) {
+            memcpy(&w, b + k, sizeof(w));
+            const f32 v = (f32)w;
+            bad |= (v != v);
+            e = polarity ? (v < e ? v : e) : (v > e ? v : e);
+        }
+        for(uint32_t j=0; j<N; j++) {
+            nan |= bad[j] != 0;
+            ext  = polarity ? std::min(ext, e[j]) : std::max(ext, e[j]);
+        }
+    }
+    for(; k<n; k++) {
+        const float v = fp32ToFloat(b[k]);
+        nan |= v != v;
+        ext  = polarity ? std::min(ext, v) : std::max(ext, v);
+    }
+    if(nan)
+        return false;
+
+    // aluState is kept if no operand replaces it
+    if(polarity ? !(aluF > ext) : (aluF > ext))
+        return true;
+
+    // index of the first minimum, or of the last maximum
+    f32 extV;
+    for(uint32_t j=0; j<N; j++)
+        extV[j] = ext;
+
+    uint32_t pos = 0;
+    if(polarity) {
+        for(k=0; k+N <= n; k+=N) {
+            u32 w;
+            memcpy(&w, b + k, sizeof(w));
+            const i32 eq = ((f32)w == extV);
+            uint32_t  j  = 0;
+            while(j < N && !eq[j])
+                j++;
+            if(j < N)
+                break;
+        }
+        while(fp32ToFloat(b[k]) != ext)
+            k++;
+        pos = k;
+    } else {
+        for(k=n; k >= N; k-=N) {
+            u32 w;
+            memcpy(&w, b + k - N, sizeof(w));
+            const i32 eq = ((f32)w == extV);
+            uint32_t  j  = 0;
+            while(j < N && !eq[j])
+                j++;
+            if(j < N)
+                break;
+        }
+        while(fp32ToFloat(b[k-1]) != ext)
+            k--;
+        pos = k-1;
+    }
+
+    alu = b[pos];
+    idx = cnt + pos;
+    return true;
+}
+
+static void
+nstSelectRowSse(const nstSelectRow & r) {
+    nstSelectRowN<4>(r);
+}
+
+static bool
+nstMaxMinRowSse(const uint32_t * b, uint32_t n, bool polarity,
+                uint32_t & alu, uint32_t & idx, uint32_t cnt) {
+    return nstMaxMinRowN<4>(b, n, polarity, alu, idx, cnt);
+}
+
+static void (* nstSelectRowImpl)(const nstSelectRow &) = nstSelectRowSse;
+static bool (* nstMaxMinRowImpl)(const uint32_t *, uint32_t, bool,
+                                 uint32_t &, uint32_t &, uint32_t) = nstMaxMinRowSse;
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target("avx2")))
+static void
+nstSelectRowAvx2(const nstSelectRow & r) {
+    nstSelectRowN<8>(r);
+}
+
+__attribute__((target("avx2")))
+static bool
+nstMaxMinRowAvx2(const uint32_t * b, uint32_t n, bool polarity,
+                 uint32_t & alu, uint32_t & idx, uint32_t cnt) {
+    return nstMaxMinRowN<8>(b, n, polarity, alu, idx, cnt);
+}
+
+static bool
+nstAutoSelectRowKernels() {
+    if(__builtin_cpu_supports("avx2")) {
+        nstSelectRowImpl = nstSelectRowAvx2;
+        nstMaxMinRowImpl = nstMaxMinRowAvx2;
+        return true;
+    }
+    return false;
+}
+
+static const bool nstRowKernelsAtStartup = nstAutoSelectRowKernels();
+#endif
+
+// the AGUs are never reset, so the address of AGU o is affine in the loop
+// indices i[l] = 0..loopBound[l] (l < outerLevel):
+//
+//   agu[o] = aguOff[o] + sum(eff[o][l] * i[l])
+//
+// the effective increment eff[o][l] of index i[l] is the stride of level l
+// plus what the inner levels have added during one iteration of level l.
+static void
+nstEffStrides(const ntx_api * ntx, int64_t eff[C_N_AGUS][C_N_HW_LOOPS]) {
+
+    for(uint32_t o=0; o < C_N_AGUS; o++) {
+        int64_t inner = 0;
+        for(uint32_t l=0; l < C_N_HW_LOOPS; l++) {
+            eff[o][l] = (l < ntx->outerLevel) ? ntx->aguStride[o][l] + inner : 0;
+            inner += eff[o][l] * (int64_t)ntx->loopBound.w[l];
+        }
+    }
+}
+
+// address range [lo, hi] of AGU o over the whole loop nest (without the size
+// of the last word)
+static void
+nstAguRange(const ntx_api * ntx, const int64_t eff[C_N_AGUS][C_N_HW_LOOPS], uint32_t o,
+            int64_t & lo, int64_t & hi) {
+
+    lo = (int64_t)(intptr_t)ntx->aguOff[o];
+    hi = lo;
+    for(uint32_t l=0; l < ntx->outerLevel; l++) {
+        if(eff[o][l] < 0)
+            lo += eff[o][l] * (int64_t)ntx->loopBound.w[l];
+        else
+            hi += eff[o][l] * (int64_t)ntx->loopBound.w[l];
+    }
+}
+
+// loop levels [0, top) of a nest, as seen by the destination agu2 and a
+// source AGU. levels that continue the level below without a gap are merged,
+// e.g. the rows of a contiguous tensor, so dimension 0 is the longest row
+// that is contiguous or uniformly strided in both AGUs.
+struct nstCopyDims {
+    uint32_t nDims;
+    uint32_t len[C_N_HW_LOOPS];
+    int64_t  dst[C_N_HW_LOOPS];
+    int64_t  src[C_N_HW_LOOPS];
+};
+
+static void
+nstCopyCollapse(const ntx_api * ntx, const int64_t eff[C_N_AGUS][C_N_HW_LOOPS],
+                uint32_t top, uint32_t o, nstCopyDims & d) {
+
+    d.nDims  = 1;
+    d.len[0] = (top > 0) ? ntx->loopBound.w[0] + 1 : 1;
+    d.dst[0] = (top > 0) ? eff[2][0] : 0;
+    d.src[0] = (top > 0) ? eff[o][0] : 0;
+
+    for(uint32_t l=1; l < top; l++) {
+        const uint32_t k   = d.nDims-1;
+        const uint64_t tmp = (uint64_t)d.len[k] * (ntx->loopBound.w[l] + 1);
+        if(eff[2][l] == d.dst[k] * d.len[k] &&
+           eff[o][l] == d.src[k] * d.len[k] && tmp < (1ULL << 32)) {
+            d.len[k] = (uint32_t)tmp;
+        } else {
+            d.len[d.nDims] = ntx->loopBound.w[l] + 1;
+            d.dst[d.nDims] = eff[2][l];
+            d.src[d.nDims] = eff[o][l];
+            d.nDims++;
+        }
+    }
+}
+
+// calls row(dst, src) for the rows (dimension 0) of d, in the order of the
+// loop nest
+template <class F>
+static void
+nstCopyWalk(const nstCopyDims & d, char * dst, const char * src, F & row) {
+
+    uint32_t idx[C_N_HW_LOOPS] = {0};
+
+    for(;;) {
+        char *       dstRow = dst;
+        const char * srcRow = src;
+        for(uint32_t k=1; k < d.nDims; k++) {
+            dstRow += d.dst[k] * idx[k];
+            srcRow += d.src[k] * idx[k];
+        }
+
+        row(dstRow, srcRow);
+
+        uint32_t k = 1;
+        while(k < d.nDims && idx[k] == d.len[k]-1)
+            idx[k++] = 0;
+        if(k == d.nDims)
+            break;
+        idx[k]++;
+    }
+}
+
+// 2D copies that gather a row from a strided source (e.g. transposes) are
+// done in tiles of C_NTX_COPY_TILE x C_NTX_COPY_TILE words, so that the
+// lines of the source are reused. the order of the stores only does not
+// matter if the source and the destination are disjoint, and if no word
+// is stored twice.
+static bool
+nstCopyIsTransposed(const nstCopyDims & d) {
+
+    if(d.nDims != 2 || std::abs(d.src[0]) <= (int64_t)sizeof(uint32_t))
+        return false;
+
+    const int64_t d0 = std::abs(d.dst[0]);
+    const int64_t d1 = std::abs(d.dst[1]);
+
+    return d0 >= (int64_t)sizeof(uint32_t) && d1 >= (int64_t)sizeof(uint32_t) &&
+           (d0 * d.len[0] <= d1 || d1 * d.len[1] <= d0);
+}
+
+static void
+nstCopyTransposed(const nstCopyDims & d, char * dst, const char * src) {
+
+    for(uint32_t i1=0; i1 < d.len[1]; i1+=C_NTX_COPY_TILE) {
+        const uint32_t n1 = std::min(d.len[1] - i1, (uint32_t)C_NTX_COPY_TILE);
+        for(uint32_t i0=0; i0 < d.len[0]; i0+=C_NTX_COPY_TILE) {
+            const uint32_t n0 = std::min(d.len[0] - i0, (uint32_t)C_NTX_COPY_TILE);
+            for(uint32_t k1=i1; k1 < i1+n1; k1++) {
+                char *       dstRow = dst + d.dst[1] * k1;
+                const char * srcRow = src + d.src[1] * k1;
+                for(uint32_t k0=i0; k0 < i0+n0; k0++)
+                    *(uint32_t *)(dstRow + d.dst[0] * k0) = *(const uint32_t *)(srcRow + d.src[0] * k0);
+            }
+        }
+    }
+}
+
+template <class OP>
+bool
+nstInternalOp::executeLastIters(OP & op, bool counts) {
+
+    const uint32_t win   = ntx->innerLevel;
+    // (outerLevel is checked by nstFuncModel, the bound is for the compiler)
+    const uint32_t outer = std::min<uint32_t>(ntx->outerLevel, C_N_HW_LOOPS);
+
+    if(win == 0)
+        return false;
+
+    int64_t eff[C_N_AGUS][C_N_HW_LOOPS];
+    nstEffStrides(ntx, eff);
+
+    // offset of the last iteration of a window from its first one, and the
+    // number of iterations of a window
+    int64_t  lastOff[C_N_AGUS] = {0};
+    uint64_t nWin = 1;
+    for(uint32_t l=0; l < win; l++) {
+        for(uint32_t o=0; o < C_N_AGUS; o++)
+            lastOff[o] += eff[o][l] * ntx->loopBound.w[l];
+        nWin *= ntx->loopBound.w[l] + 1;
+    }
+
+    // the output levels. the AGUs end up at the last iteration of the nest,
+    // as after the generic loop nest.
+    uint32_t cnt[C_N_HW_LOOPS] = {0};
+    for(;;) {
+        // first iteration of this output
+        for(uint32_t o=0; o < C_N_AGUS; o++) {
+            char * ptr = (char*)ntx->aguOff[o];
+            for(uint32_t l=win; l < outer; l++)
+                ptr += eff[o][l] * cnt[l];
+            ntx->agu[o] = ptr;
+        }
+
+        // init happens at the first output of each iteration of initLevel
+        bool init = true;
+        for(uint32_t l=win; l < ntx->initLevel; l++)
+            init &= cnt[l] == 0;
+        if(init)
+            op.init();
+
+        // skip to the last iteration of the window
+        for(uint32_t o=0; o < C_N_AGUS; o++)
+            ntx->agu[o] = (char*)ntx->agu[o] + lastOff[o];
+        if(counts)
+            ntx->cntState += (uint32_t)(nWin - 1);
+
+        op.execute();
+        op.store();
+
+        uint32_t l = win;
+        while(l < outer && cnt[l] == ntx->loopBound.w[l])
+            cnt[l++] = 0;
+        if(l == outer)
+            break;
+        cnt[l]++;
+    }
+
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // ntx emulation functions
 ///////////////////////////////////////////////////////////////////////////////
@@ -160,112 +832,783 @@ ntx_api::writeJobDump(const char *      fileName,
         fprintf(fid,"\n");
     }
 
-    fclose(fid);
-    return;
-}
+    fclose(fid);
+    return;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// loop nest and kernels
+///////////////////////////////////////////////////////////////////////////////
+
+template <class OP>
+static void
+nstLoop(ntx_api * ntx, uint32_t n)
+{
+    // the ops are created per command, but on the stack, so that issuing a
+    // command does not allocate. the n members of a uniform broadcast share
+    // the loop control, but each member keeps its own op and AGUs, and runs
+    // its rows on its own (see nstRunSharedLoop). the loop configuration is
+    // taken from the first one.
+    OP       ops[C_NTX_SHARED_LOOP_MAX];
+    uint32_t live[C_NTX_SHARED_LOOP_MAX];
+    uint32_t nLive = 0;
+
+    assert(n >= 1 && n <= C_NTX_SHARED_LOOP_MAX);
+    for(uint32_t m=0; m < n; m++)
+        ops[m].ntx = ntx + m;
+
+    // moves the AGUs of a member to the next iteration of a loop level
+    auto updateMember = [](ntx_api * mem, uint32_t level) {
+        NTX_TRACE_OP(C_NTX_TRACE_AGU_UPD, mem->opCode, level, 0, &mem->agu.w[0], 0, 0, 0);
+        for(uint32_t o=0; o < C_N_AGUS; o++) {
+            mem->agu[o] = ((char*)mem->agu[o] + mem->aguStride[o][level]);
+        }
+    };
+
+    // a member enters a loop level (one iteration of the enclosing loop)
+    auto enterMember = [](OP & op, uint32_t level) {
+        ntx_api * mem = op.ntx;
+        NTX_TRACE_OP(C_NTX_TRACE_LEVEL, mem->opCode, level, 0, &mem->agu.w[0], mem->outerLevel, 0, 0);
+        // check whether init is required
+        if (mem->initLevel == level)
+            op.init();
+    };
+
+    auto updateAgus = [&](uint32_t level) {
+        for(uint32_t k=0; k < nLive; k++)
+            updateMember(ops[live[k]].ntx, level);
+    };
+
+    auto enterLevel = [&](uint32_t level) {
+        for(uint32_t k=0; k < nLive; k++)
+            enterMember(ops[live[k]], level);
+    };
+
+    // iterative version of the HW loop nest. a level l > 0 runs
+    // loopBound[l-1]+1 iterations of level l-1 (note the inclusive bounds!!),
+    // and cnt[l-1] counts them. the AGUs are advanced by the stride of a level
+    // at the end of each of its iterations, except for the last one. level 0
+    // is the body in which the command is executed.
+    uint32_t cnt[C_N_HW_LOOPS] = {0};
+    uint32_t level = ntx->outerLevel;
+    bool     down  = true;
+
+    // the ops may recognize the whole nest and run it in one go
+    for(uint32_t m=0; m < n; m++) {
+#ifndef NTX_TRACE_ON
+        if (ops[m].executeNest())
+            continue;
+#endif
+        live[nLive++] = m;
+    }
+    if (nLive == 0)
+        return;
+
+    for(;;) {
+        if (down) {
+            enterLevel(level);
+
+            if (level == 0) {
+                // single iteration command
+                for(uint32_t k=0; k < nLive; k++)
+                    ops[live[k]].execute();
+                down = false;
+            } else if (level == 1) {
+                // innermost loop, member by member
+                for(uint32_t k=0; k < nLive; k++) {
+                    OP &      op  = ops[live[k]];
+                    ntx_api * mem = op.ntx;
+#ifndef NTX_TRACE_ON
+                    if (op.executeRow(mem->loopBound.w[0] + 1)) {
+                        // the op has processed the innermost loop in one go,
+                        // so move the AGUs to the last iteration, as the per
+                        // iteration updates would have done
+                        for(uint32_t o=0; o < C_N_AGUS; o++) {
+                            mem->agu[o] = ((char*)mem->agu[o] + mem->aguStride[o][0] * (int32_t)mem->loopBound.w[0]);
+                        }
+                        continue;
+                    }
+#endif
+                    for(uint32_t i=0;; i++) {
+                        enterMember(op, 0);
+                        op.execute();
+                        // check whether writeback is required
+                        if (mem->innerLevel == 0)
+                            op.store();
+                        if (i == mem->loopBound.w[0])
+                            break;
+                        updateMember(mem, 0);
+                    }
+                }
+                down = false;
+            } else {
+                // descend into the first iteration of the next level
+                level--;
+                cnt[level] = 0;
+            }
+            continue;
+        }
+
+        // leaving a level. check whether writeback is required
+        if (ntx->innerLevel == level)
+            for(uint32_t k=0; k < nLive; k++)
+                ops[live[k]].store();
+
+        if (level == ntx->outerLevel)
+            break;
+
+        if (cnt[level] < ntx->loopBound.w[level]) {
+            // next iteration of this level
+            updateAgus(level);
+            cnt[level]++;
+            down = true;
+        } else {
+            // this was the last iteration, so leave the enclosing level too
+            level++;
+        }
+    }
+}
+
+// op type for opcode OPCODE and aux function AUX
+template <uint8_t OPCODE, uint8_t AUX> struct nstKernelSel;
+template <uint8_t AUX> struct nstKernelSel<C_NTX_MAC_OP,     AUX> { typedef nstMacOp<AUX != 0>     type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_VADDSUB_OP, AUX> { typedef nstVAddSubOp<AUX != 0> type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_VMULT_OP,   AUX> { typedef nstVMultOp<AUX != 0>   type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_OUTERP_OP,  AUX> { typedef nstOuterPOp<AUX != 0>  type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_MAXMIN_OP,  AUX> { typedef nstMaxMinOp<AUX != 0>  type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_THTST_OP,   AUX> { typedef nstThTstOp<AUX>        type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_MASK_OP,    AUX> { typedef nstMaskOp<AUX>         type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_MASKMAC_OP, AUX> { typedef nstMaskMacOp<AUX>      type; };
+template <uint8_t AUX> struct nstKernelSel<C_NTX_COPY_OP,    AUX> { typedef nstCopyOp<(AUX & 0x1) != 0> type; };
+
+#define NTX_KERNEL(OPCODE, AUX) nstLoop<nstKernelSel<OPCODE, AUX>::type>
+#define NTX_KERNELS(OPCODE) {NTX_KERNEL(OPCODE, 0), NTX_KERNEL(OPCODE, 1), NTX_KERNEL(OPCODE, 2), NTX_KERNEL(OPCODE, 3), \
+                             NTX_KERNEL(OPCODE, 4), NTX_KERNEL(OPCODE, 5), NTX_KERNEL(OPCODE, 6), NTX_KERNEL(OPCODE, 7)}
+
+// dispatch table, indexed with opcode and aux function
+typedef void (*nstKernelType)(ntx_api *, uint32_t);
+
+static const nstKernelType nstKernels[C_N_NTX_OPCODES][1 << C_NTX_AUX_WIDTH] = {
+    NTX_KERNELS(C_NTX_MAC_OP),
+    NTX_KERNELS(C_NTX_VADDSUB_OP),
+    NTX_KERNELS(C_NTX_VMULT_OP),
+    NTX_KERNELS(C_NTX_OUTERP_OP),
+    NTX_KERNELS(C_NTX_MAXMIN_OP),
+    NTX_KERNELS(C_NTX_THTST_OP),
+    NTX_KERNELS(C_NTX_MASK_OP),
+    NTX_KERNELS(C_NTX_MASKMAC_OP),
+    NTX_KERNELS(C_NTX_COPY_OP)
+};
+
+#undef NTX_KERNELS
+#undef NTX_KERNEL
+
+// copies the staged command, without the emulation state of the NTX (job
+// queue, timing model, cluster), whose shared pointers are expensive to copy
+static void
+nstCopyCmd(ntx_api & dst, const ntx_api & src) {
+    dst.tcdmLow        = src.tcdmLow;
+    dst.tcdmHigh       = src.tcdmHigh;
+    dst.checkTcdmAddrs = src.checkTcdmAddrs;
+    dst.initLevel      = src.initLevel;
+    dst.innerLevel     = src.innerLevel;
+    dst.outerLevel     = src.outerLevel;
+    dst.opCode         = src.opCode;
+    dst.initSel        = src.initSel;
+    dst.auxFunc        = src.auxFunc;
+    dst.irqCfg         = src.irqCfg;
+    dst.polarity       = src.polarity;
+    dst.loopBound      = src.loopBound;
+    dst.aguOff         = src.aguOff;
+    dst.aguStride      = src.aguStride;
+}
+
+// copies the state that a command leaves behind in the NTX
+static void
+nstCopyState(ntx_api & dst, const ntx_api & src) {
+    dst.agu           = src.agu;
+    dst.maskAccuState = src.maskAccuState;
+    dst.csAccuState   = src.csAccuState;
+    dst.aluState      = src.aluState;
+    dst.prodState     = src.prodState;
+    dst.cntState      = src.cntState;
+    dst.idxState      = src.idxState;
+}
+
+// traced builds run all commands serially, so that the trace points keep
+// their order (see nstFuncModel)
+#ifndef NTX_TRACE_ON
+
+// the iterations of the outermost loop level are independent if each of them
+// inits and stores its own outputs, if the outputs of different iterations
+// do not overlap, and if no iteration reads what another one writes. the
+// reads through agu2 (read-modify-write of MASKMAC, init) and exactly in
+// place reads through agu0/1 stay within the outputs of their iteration. a
+// nest that accumulates into the same outputs in every iteration (as MASKMAC
+// usually does) therefore stays serial.
+static bool
+nstIsParallel(const ntx_api * ntx, const int64_t eff[C_N_AGUS][C_N_HW_LOOPS]) {
+
+    const uint32_t p = ntx->outerLevel - 1;
+
+    if(ntx->outerLevel == 0 || ntx->initLevel > p || ntx->loopBound.w[p] == 0)
+        return false;
+
+    // (A)MAX and (A)MIN carry the index of the last update from one output
+    // to the next (it is not reset by init)
+    if(ntx->opCode == C_NTX_MAXMIN_OP)
+        return false;
+
+    // the outputs of one iteration span the inner levels
+    int64_t span = sizeof(uint32_t);
+    for(uint32_t l=0; l < p; l++)
+        span += std::abs(eff[2][l]) * (int64_t)ntx->loopBound.w[l];
+    if(std::abs(eff[2][p]) < span)
+        return false;
+
+    int64_t resLo, resHi;
+    nstAguRange(ntx, eff, 2, resLo, resHi);
+    resHi += sizeof(uint32_t);
+
+    for(uint32_t o=0; o < 2; o++) {
+        int64_t opLo, opHi;
+        nstAguRange(ntx, eff, o, opLo, opHi);
+        opHi += sizeof(uint32_t);
+
+        bool inPlace = (ntx->aguOff[o] == ntx->aguOff[2]);
+        for(uint32_t l=0; l < ntx->outerLevel; l++)
+            inPlace &= (eff[o][l] == eff[2][l]);
+
+        if(!inPlace && opHi > resLo && resHi > opLo)
+            return false;
+    }
+
+    return true;
+}
+
+// splits the iterations of the outermost loop level of large commands into
+// contiguous chunks, which run on the thread pool. each chunk runs the
+// kernel on its own copy of the command and state of the NTX, whose AGU
+// offsets and loop bound are moved to the chunk. returns false if the
+// command has to run serially.
+static bool
+nstRunParallel(ntx_api * ntx) {
+
+    ntxThreadPool & pool = ntxThreadPool::instance();
+    if(pool.size() == 1 || ntx->outerLevel == 0)
+        return false;
+
+    uint64_t nIters = 1;
+    for(uint32_t l=0; l < ntx->outerLevel; l++)
+        nIters *= ntx->loopBound.w[l] + 1;
+    if(nIters < C_NTX_PAR_MIN_ITERS)
+        return false;
+
+    int64_t eff[C_N_AGUS][C_N_HW_LOOPS];
+    nstEffStrides(ntx, eff);
+
+    if(!nstIsParallel(ntx, eff))
+        return false;
+
+    const uint32_t p       = ntx->outerLevel - 1;
+    const uint32_t nOuter  = ntx->loopBound.w[p] + 1;
+    const uint32_t nChunks = std::min(pool.size(), nOuter);
+
+    // the last chunk leaves the state of the NTX behind
+    ntx_api last;
+
+    auto chunk = [&](uint32_t k) {
+        const uint32_t begin = (uint64_t)nOuter * k / nChunks;
+        const uint32_t end   = (uint64_t)nOuter * (k+1) / nChunks;
+
+        ntx_api part;
+        nstCopyCmd(part, *ntx);
+        nstCopyState(part, *ntx);
+        part.loopBound.w[p] = end - begin - 1;
+        for(uint32_t o=0; o < C_N_AGUS; o++)
+            part.aguOff[o] = (char*)ntx->aguOff[o] + eff[o][p] * begin;
+        memcpy(&part.agu, &part.aguOff, sizeof(nst_aguType));
+
+        nstKernels[part.opCode][part.auxFunc](&part, 1);
+
+        if(k == nChunks-1)
+            nstCopyState(last, part);
+    };
+
+    pool.run(nChunks, chunk);
+
+    nstCopyState(*ntx, last);
+
+    return true;
+}
+
+#endif
+
+void
+ntx_api::checkAguFootprint ()
+{
+    int64_t eff[C_N_AGUS][C_N_HW_LOOPS];
+    nstEffStrides(this, eff);
+
+    for(uint32_t o=0; o < C_N_AGUS; o++) {
+        int64_t lo, hi;
+        nstAguRange(this, eff, o, lo, hi);
+
+        const bool loOk = lo >= (int64_t)(intptr_t)tcdmLow;
+        const bool hiOk = hi <= (int64_t)(intptr_t)tcdmHigh;
+
+        if(loOk && hiOk)
+            continue;
+
+        // report the iteration with the extreme address
+        fprintf(stderr, "NTX AGU%u leaves the TCDM [%p, %p]: address %p at iteration (",
+                o, tcdmLow, tcdmHigh, (void*)(intptr_t)(loOk ? hi : lo));
+        for(uint32_t l=0; l < outerLevel; l++) {
+            const bool atBound = loOk ? (eff[o][l] > 0) : (eff[o][l] < 0);
+            fprintf(stderr, "%si%u = %u", l ? ", " : "", l, atBound ? loopBound.w[l] : 0);
+        }
+        fprintf(stderr, ")\n");
+
+        assert(loOk && hiOk);
+    }
+}
+
+void
+ntx_api::nstFuncModel ()
+{
+
+    // some sanity checks...
+    assert(initLevel  >= innerLevel);
+    assert(outerLevel >= innerLevel);
+    assert(outerLevel >= initLevel);
+    assert(C_N_HW_LOOPS   >= outerLevel);
+    assert(C_N_NTX_OPCODES > opCode);
+    assert((1 << C_NTX_AUX_WIDTH) > auxFunc);
+    for(uint32_t k=0; k< C_N_HW_LOOPS; k++)
+        assert(loopBound[k] < (1ULL << C_HW_LOOP_WIDTH));
+
+    // do some sanity checks on AGUs in order to detect malicious
+    // configurations. this covers all iterations, so the loop nest itself
+    // runs without checks.
+    if(checkTcdmAddrs)
+        checkAguFootprint();
+
+    // AGU init
+    memcpy(&agu, &aguOff, sizeof(nst_aguType));
+
+    // run the kernel of this command, on the thread pool if possible
+#ifndef NTX_TRACE_ON
+    if(nstRunParallel(this))
+        return;
+#endif
+    nstKernels[opCode][auxFunc](this, 1);
+
+  return;
+}
+
+
+// address range [lo, hi) of AGU o of a member of a broadcast NTX
+static void
+nstMemberRange(const ntx_api * ntx, uint32_t o, int64_t & lo, int64_t & hi) {
+
+    int64_t eff[C_N_AGUS][C_N_HW_LOOPS];
+    nstEffStrides(ntx, eff);
+    nstAguRange(ntx, eff, o, lo, hi);
+    hi += sizeof(uint32_t);
+}
+
+// true if no member of a broadcast NTX stores (agu2) to an address range
+// of another member. the ranges cover whole loop nests, so interleaved
+// members are treated as overlapping. the members of a uniform broadcast
+// share the extent of their ranges, which is then computed only once.
+static bool
+nstBroadcastIsDisjoint(const ntx_api * begin, const ntx_api * end, bool uniform) {
+
+    int64_t ext[C_N_AGUS][2];
+    if(uniform) {
+        for(uint32_t o=0; o < C_N_AGUS; o++) {
+            nstMemberRange(begin, o, ext[o][0], ext[o][1]);
+            ext[o][0] -= (int64_t)(intptr_t)begin->aguOff[o];
+            ext[o][1] -= (int64_t)(intptr_t)begin->aguOff[o];
+        }
+    }
+
+    auto range = [&](const ntx_api * ntx, uint32_t o, int64_t & lo, int64_t & hi) {
+        if(uniform) {
+            lo = (int64_t)(intptr_t)ntx->aguOff[o] + ext[o][0];
+            hi = (int64_t)(intptr_t)ntx->aguOff[o] + ext[o][1];
+        } else {
+            nstMemberRange(ntx, o, lo, hi);
+        }
+    };
+
+    for(const ntx_api * k = begin; k != end; ++k) {
+        int64_t resLo, resHi;
+        range(k, 2, resLo, resHi);
+
+        for(const ntx_api * j = begin; j != end; ++j) {
+            for(uint32_t o=0; o < C_N_AGUS && j != k; o++) {
+                int64_t opLo, opHi;
+                range(j, o, opLo, opHi);
+                if(resHi > opLo && opHi > resLo)
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// true if all members of a broadcast NTX have staged the same command,
+// apart from the AGU offsets
+static bool
+nstBroadcastIsUniform(const ntx_api * begin, const ntx_api * end) {
+
+    for(const ntx_api * ntx = begin+1; ntx < end; ++ntx) {
+        if(ntx->opCode     != begin->opCode     ||
+           ntx->auxFunc    != begin->auxFunc    ||
+           ntx->initSel    != begin->initSel    ||
+           ntx->polarity   != begin->polarity   ||
+           ntx->initLevel  != begin->initLevel  ||
+           ntx->innerLevel != begin->innerLevel ||
+           ntx->outerLevel != begin->outerLevel)
+            return false;
+
+        for(uint32_t l=0; l < C_N_HW_LOOPS; l++) {
+            if(ntx->loopBound.w[l] != begin->loopBound.w[l])
+                return false;
+            for(uint32_t o=0; o < C_N_AGUS; o++)
+                if(ntx->aguStride[o][l] != begin->aguStride[o][l])
+                    return false;
+        }
+    }
+
+    return true;
+}
+
+// number of members of a uniform broadcast that share one loop control. the
+// ops with long accumulation chains (MAC, VADDSUB, MASKMAC) are faster one by
+// one, as their state then stays in registers. there is no vectorization
+// across members, the accumulators of each member stay in its own op.
+static uint32_t
+nstSharedLoopGroup(const ntx_api * ntx) {
+
+    switch(ntx->opCode) {
+        case C_NTX_MAC_OP:
+        case C_NTX_VADDSUB_OP:
+        case C_NTX_MASKMAC_OP:
+            return 1;
+        default:
+            return C_NTX_SHARED_LOOP_MAX;
+    }
+}
+
+// issues the same command on n members of a broadcast NTX, which share the
+// loop control of one loop nest. the sanity checks of the command, the kernel
+// dispatch and the loop counters are shared, the AGU checks are done per
+// member.
+static void
+nstRunSharedLoop(ntx_api * ntx, uint32_t n) {
+
+    assert(ntx->initLevel  >= ntx->innerLevel);
+    assert(ntx->outerLevel >= ntx->innerLevel);
+    assert(ntx->outerLevel >= ntx->initLevel);
+    assert(C_N_HW_LOOPS   >= ntx->outerLevel);
+    assert(C_N_NTX_OPCODES > ntx->opCode);
+    assert((1 << C_NTX_AUX_WIDTH) > ntx->auxFunc);
+    for(uint32_t k=0; k< C_N_HW_LOOPS; k++)
+        assert(ntx->loopBound[k] < (1ULL << C_HW_LOOP_WIDTH));
+
+    for(uint32_t m=0; m < n; m++) {
+        if(ntx[m].cluster || ntx[m].perfModel)
+            ntx[m].recordCmd();
+        if(ntx[m].checkTcdmAddrs)
+            ntx[m].checkAguFootprint();
+        memcpy(&ntx[m].agu, &ntx[m].aguOff, sizeof(nst_aguType));
+    }
+
+    nstKernels[ntx->opCode][ntx->auxFunc](ntx, n);
+
+    for(uint32_t m=0; m < n; m++)
+        ntx[m].irqReg = ntx[m].irqCfg > 0;
+}
+
+void
+ntx_api::setPerfModel (bool on)
+{
+    if (broadcast) {
+        for (auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
+            ntx->setPerfModel(on);
+        return;
+    }
+
+    perfModel = on ? std::make_shared<ntxTimingModel>() : nullptr;
+    lastPerf  = ntxPerfEstimate();
+}
+
+ntxPerfEstimate
+ntx_api::estimateCmd () const
+{
+    assert(!broadcast);
+    ntxTimingModel model;
+    return model.runIdeal(ntxTimingJobOf(*this, nullptr));
+}
+
+void
+ntx_api::recordCmd ()
+{
+    if (cluster)
+        cluster->record(*this);
+    if (perfModel)
+        lastPerf = perfModel->runIdeal(ntxTimingJobOf(*this, nullptr));
+}
+
+void
+ntx_api::issueBroadcast ()
+{
+    ntxThreadPool & pool = ntxThreadPool::instance();
+    const uint32_t  n    = broadcastEnd - broadcast;
+
+    uint64_t nIters = 0;
+    bool     async  = false;
+    for(auto ntx = broadcast; ntx != broadcastEnd; ++ntx) {
+        uint64_t iters = 1;
+        for(uint32_t l=0; l < ntx->outerLevel; l++)
+            iters *= ntx->loopBound.w[l] + 1;
+        nIters += iters;
+        async  |= (bool)ntx->jobQueue;
+    }
+
+    // async members run on their own
+    const bool threads    = !async && pool.size() > 1 && nIters >= C_NTX_PAR_MIN_ITERS;
+    bool       sharedLoop = !async && n > 1 && nstSharedLoopGroup(broadcast) > 1;
+#ifdef NTX_TRACE_ON
+    // keep the order of the trace points
+    sharedLoop = false;
+#endif
+    const bool uniform    = (sharedLoop || threads) && nstBroadcastIsUniform(broadcast, broadcastEnd);
+    sharedLoop = sharedLoop && uniform;
+
+    if((!sharedLoop && !threads) || !nstBroadcastIsDisjoint(broadcast, broadcastEnd, uniform)) {
+        for(auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
+            ntx->issueCmd();
+        return;
+    }
+
+    // groups of members that share one loop control, or single members, one
+    // after the other or on the thread pool. the members split their
+    // commands no further, see ntxThreadPool::run.
+    const uint32_t maxGroup = sharedLoop ? nstSharedLoopGroup(broadcast) : 1;
+    uint32_t       nGroups  = (n + maxGroup - 1) / maxGroup;
+    if(threads)
+        nGroups = std::max(nGroups, std::min(pool.size(), n));
+
+    auto group = [&](uint32_t k) {
+        const uint32_t begin = (uint64_t)n * k / nGroups;
+        const uint32_t end   = (uint64_t)n * (k+1) / nGroups;
+        if(sharedLoop)
+            nstRunSharedLoop(broadcast + begin, end - begin);
+        else
+            broadcast[begin].issueCmd();
+    };
+
+    if(threads) {
+        pool.run(nGroups, group);
+    } else {
+        for(uint32_t k=0; k < nGroups; k++)
+            group(k);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// asynchronous mode
+///////////////////////////////////////////////////////////////////////////////
+
+// the job FIFO of one NTX. the slots hold the staged commands, the one at
+// head is being executed by the worker. the worker runs each command on a
+// copy of the NTX state, so the host may stage the next command in the
+// meantime.
+class ntxJobQueue {
+    public:
+
+    explicit ntxJobQueue(ntx_api * host_) :
+        host(host_),
+        worker(&ntxJobQueue::work, this) {
+    }
+
+    // waits until all commands have been executed
+    ~ntxJobQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        worker.join();
+    }
+
+    void
+    push() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return count < C_NTX_JOB_SLOTS; });
+
+        nstCopyCmd(slots[(head + count) % C_NTX_JOB_SLOTS], *host);
 
+        count++;
+        cond.notify_all();
+    }
 
-void
-ntx_api::nstFuncModel ()
-{
+    bool
+    isIdle() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count == 0;
+    }
 
-    // some sanity checks...
-    assert(initLevel  >= innerLevel);
-    assert(outerLevel >= innerLevel);
-    assert(outerLevel >= initLevel);
-    assert(C_N_HW_LOOPS   >= outerLevel);
-    assert(C_N_NTX_OPCODES > opCode);
-    for(uint32_t k=0; k< C_N_HW_LOOPS; k++)
-        assert(loopBound[k] < (1ULL << C_HW_LOOP_WIDTH));
+    bool
+    isReady() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count < C_NTX_JOB_SLOTS;
+    }
 
-    // AGU init
-    memcpy(&agu, &aguOff, sizeof(nst_aguType));
+    bool
+    hasIrq() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return host->irqReg;
+    }
 
-    //select corresponding fpu Operation
-    nstInternalOp * op;
-    switch (opCode) {
-        case C_NTX_MAC_OP:
-            op = new nstMacOp(this);
-            break;
-        case C_NTX_VADDSUB_OP:
-            op = new nstVAddSubOp(this);
-            break;
-        case C_NTX_VMULT_OP:
-            op = new nstVMultOp(this);
-            break;
-        case C_NTX_OUTERP_OP:
-            op = new nstOuterPOp(this);
-            break;
-        case C_NTX_MAXMIN_OP:
-            op = new nstMaxMinOp(this);
-            break;
-        case C_NTX_THTST_OP:
-            op = new nstThTstOp(this);
-            break;
-        case C_NTX_MASK_OP:
-            op = new nstMaskOp(this);
-            break;
-        case C_NTX_MASKMAC_OP:
-            op = new nstMaskMacOp(this);
-            break;
-        case C_NTX_COPY_OP:
-            op = new nstCopyOp(this);
-            break;
-        default:
-            assert(0);
+    void
+    clrIrq() {
+        std::lock_guard<std::mutex> lock(mutex);
+        host->irqReg = false;
     }
 
-    // define resursive function for NTX loops...
-    std::function<void(uint32_t, nstInternalOp&, bool)> nstLooper;
-    nstLooper = [this, &nstLooper](uint32_t level, nstInternalOp & op, bool isLast) {
+    void
+    wait(bool idle) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return idle ? count == 0 : count < C_NTX_JOB_SLOTS; });
+    }
 
-    // do some sanity checks onn AGUs in order to detect malicious configurations
-    if(checkTcdmAddrs) {
-        assert(agu[0] >= tcdmLow && agu[0] <= tcdmHigh);
-        assert(agu[1] >= tcdmLow && agu[1] <= tcdmHigh);
-        assert(agu[2] >= tcdmLow && agu[2] <= tcdmHigh);
+    private:
+
+    // the command being executed, plus the FIFO
+    static const uint32_t C_NTX_JOB_SLOTS = C_NST_JOB_FIFO_DEPTH + 1;
+
+    void
+    work() {
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return stop || count > 0; });
+                if(count == 0)
+                    return;
+            }
+
+            // only the worker touches the state of the host while the
+            // queue is not empty
+            ntx_api & job = slots[head];
+            nstCopyState(job, *host);
+            job.nstFuncModel();
+            nstCopyState(*host, job);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                host->irqReg = job.irqCfg > 0;
+                head = (head + 1) % C_NTX_JOB_SLOTS;
+                count--;
+            }
+            cond.notify_all();
+        }
     }
 
-#if NTX_DEBUG_LEVEL > 0
-    for(uint32_t k=level; k<outerLevel;k++)
-        printf("---");
+    ntx_api *               host;
+    ntx_api                 slots[C_NTX_JOB_SLOTS];
+    uint32_t                head  = 0;
+    uint32_t                count = 0;
+    bool                    stop  = false;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    std::thread             worker;
+};
 
-    printf("level %d\n", level);
-#endif
+ntxJobQueueRef::ntxJobQueueRef (const ntxJobQueueRef & other)
+{
+    if(other.queue)
+        other.queue->wait(true);
+}
 
-    // check whether init is required
-    if (initLevel == level)
-        op.init();
+ntxJobQueueRef &
+ntxJobQueueRef::operator= (const ntxJobQueueRef & other)
+{
+    if(other.queue)
+        other.queue->wait(true);
+    if(queue)
+        queue->wait(true);
+    return *this;
+}
 
-    // execution of the command only happens in the body of the innermost loop...
-    if (level == 0) {
-        op.execute();
-    } else {
-        // otherwise, do another loop. note the inclusive bounds!!
-        for(uint32_t k=0; k <= loopBound.w[level-1]; k++)
-            nstLooper(level-1, op, (k == loopBound.w[level-1]));
-    }
+ntxJobQueueRef::~ntxJobQueueRef ()
+{
+    delete queue;
+}
 
-    // check whether writeback is required
-    if (innerLevel == level)
-        op.store();
+void
+ntxJobQueueRef::reset (ntxJobQueue * queue_)
+{
+    delete queue;
+    queue = queue_;
+}
 
-    // AGU update
-    if((level<C_N_HW_LOOPS) && !isLast) {
- #if NTX_DEBUG_LEVEL > 0
-            printf("level %d AGU update (isLast = %d)\n", level, (int)isLast);
- #endif
-        for(uint32_t o=0; o < C_N_AGUS; o++) {
-            agu[o] = ((char*)agu[o] + aguStride[o][level]);
-        }
+void
+ntx_api::setAsyncMode (bool async)
+{
+    if(broadcast) {
+        for(auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
+            ntx->setAsyncMode(async);
+        return;
     }
 
-    };
+    if(async && !jobQueue)
+        jobQueue.reset(new ntxJobQueue(this));
+    else if(!async && jobQueue) {
+        jobQueue->wait(true);
+        jobQueue.reset();
+    }
+}
+
+void
+ntx_api::queuePush ()
+{
+    jobQueue->push();
+}
 
-    // call the loop
-    nstLooper(outerLevel, *op, true);
+bool
+ntx_api::queueIsIdle ()
+{
+    return jobQueue->isIdle();
+}
 
-  return;
+bool
+ntx_api::queueIsReady ()
+{
+    return jobQueue->isReady();
+}
+
+bool
+ntx_api::queueHasIrq ()
+{
+    return jobQueue->hasIrq();
+}
+
+void
+ntx_api::queueClrIrq ()
+{
+    jobQueue->clrIrq();
+}
+
+void
+ntx_api::queueWait (bool idle)
+{
+    jobQueue->wait(idle);
 }
 
 
@@ -273,81 +1616,274 @@ ntx_api::nstFuncModel ()
 // NTX_MAC
 ///////////////////////////////////////////////////////////////////////////////
 
+template <bool RELU>
 void
-nstMacOp::init() {
+nstMacOp<RELU>::init() {
 
     if(ntx->initSel >= 3) {
-        ntx->accuState.clear();
-#if NTX_DEBUG_LEVEL > 1
-        printf("NTX_MAC: init accu with zero\n");
-#endif
+        ntx->csAccuState.clear();
+        NTX_TRACE_CMD(C_NTX_TRACE_INIT_ZERO, 0, 0, 0, 0);
     }
     else {
         uint32_t * res = (uint32_t *)ntx->agu[ntx->initSel];
-        pcsMac ((*res),
-                C_FP32_ONE_VAL,
-                1,
-                0,
-                0,
-                ntx->accuState,
-                (*res));
-#if NTX_DEBUG_LEVEL > 1
-        printf("init accu with res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-#endif
+        pcsMacT<true, false> ((*res),
+                              C_FP32_ONE_VAL,
+                              0,
+                              ntx->csAccuState,
+                              (*res));
+        NTX_TRACE_CMD(C_NTX_TRACE_INIT_ACCU, 0, *res, 0, 0);
     }
 
-#if NTX_DEBUG_LEVEL > 1
-            printf("op: NTX_MAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
-
 }
 
+template <bool RELU>
 void
-nstMacOp::execute() {
+nstMacOp<RELU>::execute() {
 
     uint32_t res;
     uint32_t * opA = (uint32_t *)ntx->agu[0];
     uint32_t * opB = (uint32_t *)ntx->agu[1];
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opA = %f (0x%08X), opB = %f (0x%08X)\n",fp32ToFloat(*opA), *opA, fp32ToFloat(*opB), *opB);
-    printf("op: NTX_MAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_A | C_NTX_TRACE_FETCH_B, *opA, *opB, 0);
 
     // call the bittrue model
-    pcsMac ((*opA),
-            (*opB),
-            0,
-            ntx->polarity,
-            0,
-            ntx->accuState,
-            res);
+    pcsMacT<false, false> ((*opA),
+                           (*opB),
+                           ntx->polarity,
+                           ntx->csAccuState,
+                           res);
+
+}
+
+template <bool RELU>
+bool
+nstMacOp<RELU>::executeRow(uint32_t n) {
+
+    // the element-wise case is not batched
+    if(ntx->innerLevel == 0)
+        return false;
+
+    // call the bittrue model on the whole row
+    pcsMacDot ((uint32_t *)ntx->agu[0],
+               ntx->aguStride[0][0],
+               (uint32_t *)ntx->agu[1],
+               ntx->aguStride[1][0],
+               n,
+               ntx->polarity,
+               ntx->csAccuState);
+
+    return true;
+}
+
+// dense MAC nests (dot products, GEMV, GEMM, convolutions) which init and
+// store once per output: the levels below innerLevel form the window of the
+// dot product of one output, and the levels above enumerate the outputs.
+// the window is processed with binned accumulators, whose bins are only
+// folded when an output is stored. the outputs of the first output level
+// are processed in tiles of C_NTX_MAC_TILE, such that the operands of
+// neighboring outputs are fetched together. the accumulation is exact, so
+// the result does not depend on the order of the products.
+template <bool RELU>
+bool
+nstMacOp<RELU>::executeNest() {
+
+    const uint32_t win   = ntx->innerLevel;
+    const uint32_t outer = ntx->outerLevel;
+
+    if(win == 0 || ntx->initLevel != win)
+        return false;
+
+    int64_t eff[C_N_AGUS][C_N_HW_LOOPS];
+    nstEffStrides(ntx, eff);
+
+    // the kernels take 32bit strides
+    for(uint32_t o=0; o < C_N_AGUS; o++)
+        for(uint32_t l=0; l < outer; l++)
+            if(eff[o][l] != (int32_t)eff[o][l])
+                return false;
+
+    // collapse window levels that continue the level below without a gap,
+    // e.g. the channels of a 1x1 convolution. dimension 0 is the row that
+    // is passed to pcsMacDotTile.
+    uint32_t nDims = 1;
+    uint32_t len[C_N_HW_LOOPS];
+    int32_t  strideA[C_N_HW_LOOPS];
+    int32_t  strideB[C_N_HW_LOOPS];
+
+    len[0]     = ntx->loopBound.w[0] + 1;
+    strideA[0] = (int32_t)eff[0][0];
+    strideB[0] = (int32_t)eff[1][0];
+
+    for(uint32_t l=1; l < win; l++) {
+        const uint32_t d   = nDims-1;
+        const uint64_t tmp = (uint64_t)len[d] * (ntx->loopBound.w[l] + 1);
+        if(eff[0][l] == (int64_t)strideA[d] * len[d] &&
+           eff[1][l] == (int64_t)strideB[d] * len[d] && tmp < (1ULL << 32)) {
+            len[d] = (uint32_t)tmp;
+        } else {
+            len[nDims]     = ntx->loopBound.w[l] + 1;
+            strideA[nDims] = (int32_t)eff[0][l];
+            strideB[nDims] = (int32_t)eff[1][l];
+            nDims++;
+        }
+    }
+
+    // init reads at the first iteration of the window, and the store
+    // writes at the last one (the AGUs are not reset), i.e. resOff bytes
+    // further
+    int64_t resOff = 0;
+    for(uint32_t l=0; l < win; l++)
+        resOff += eff[2][l] * ntx->loopBound.w[l];
+
+    // the outputs of a tile are all read before the first one is stored, so
+    // tiles require that no store feeds a load. this is the case if the
+    // stores do not overlap with the operands, and if no output of the tile
+    // is initialized through agu2 from a location that an earlier output of
+    // the tile is stored to.
+    uint32_t tile = 1;
+    if(win < outer) {
+        int64_t resLo, resHi;
+        nstAguRange(ntx, eff, 2, resLo, resHi);
+        resHi += sizeof(uint32_t);
+
+        bool disjoint = true;
+        for(uint32_t o=0; o < 2; o++) {
+            int64_t opLo, opHi;
+            nstAguRange(ntx, eff, o, opLo, opHi);
+            opHi += sizeof(uint32_t);
+            disjoint &= (opHi <= resLo) || (resHi <= opLo);
+        }
+
+        for(uint32_t k=1; k < C_NTX_MAC_TILE && ntx->initSel == 2; k++)
+            disjoint &= (resOff != k * eff[2][win]);
+
+        if(disjoint)
+            tile = C_NTX_MAC_TILE;
+    }
 
+    // the bins are left cleared by pcsBinResolve, so that they are only
+    // cleared once per command
+    fp32_binAccuType acc[C_NTX_MAC_TILE];
+    const uint32_t   nOut0 = (win < outer) ? ntx->loopBound.w[win] + 1 : 1;
+    uint32_t         cnt[C_N_HW_LOOPS+1] = {0};
+    char *           base[C_N_AGUS];
+    uint32_t         dim[C_N_HW_LOOPS] = {0};
+    int32_t          tileStride[C_N_AGUS] = {0};
+
+    for(uint32_t o=0; o < C_N_AGUS && win < outer; o++)
+        tileStride[o] = (int32_t)eff[o][win];
+
+    for(;;) {
+        // first address of the outputs in this tile
+        const uint32_t nTile = std::min(tile, nOut0 - cnt[win]);
+        for(uint32_t o=0; o < C_N_AGUS; o++) {
+            base[o] = (char*)ntx->aguOff[o];
+            for(uint32_t l=win; l < outer; l++)
+                base[o] += eff[o][l] * cnt[l];
+        }
+        // init
+        for(uint32_t t=0; t < nTile; t++) {
+            if(ntx->initSel >= 3) {
+                acc[t].cs.clear();
+            } else {
+                uint32_t * res = (uint32_t *)(base[ntx->initSel] + (int64_t)t * tileStride[ntx->initSel]);
+                pcsMacT<true, false> ((*res),
+                                      C_FP32_ONE_VAL,
+                                      0,
+                                      acc[t].cs,
+                                      (*res));
+            }
+        }
+
+        // walk the window, one row at a time
+        for(;;) {
+            const char * ptrA = base[0];
+            const char * ptrB = base[1];
+            for(uint32_t d=1; d < nDims; d++) {
+                ptrA += (int64_t)strideA[d] * dim[d];
+                ptrB += (int64_t)strideB[d] * dim[d];
+            }
+
+            pcsMacDotTile ((const uint32_t *)ptrA,
+                           strideA[0],
+                           tileStride[0],
+                           (const uint32_t *)ptrB,
+                           strideB[0],
+                           tileStride[1],
+                           len[0],
+                           nTile,
+                           ntx->polarity,
+                           acc);
+
+            uint32_t d = 1;
+            while(d < nDims && dim[d] == len[d]-1)
+                dim[d++] = 0;
+            if(d == nDims)
+                break;
+            dim[d]++;
+        }
+
+        // store
+        for(uint32_t t=0; t < nTile; t++) {
+            uint32_t * res = (uint32_t *)(base[2] + resOff + (int64_t)t * tileStride[2]);
+
+            // call the bittrue model
+            pcsBinResolve(acc[t]);
+            pcsMacT<false, true> (C_FP32_ZERO_VAL,
+                                  C_FP32_ZERO_VAL,
+                                  0,
+                                  acc[t].cs,
+                                  (*res));
+
+            // apply ReLu if required
+            if(RELU && fp32_getSign((*res))) {
+                (*res) = C_FP32_ZERO_VAL;
+            }
+        }
+
+        // next tile
+        cnt[win] += nTile;
+        uint32_t l = win;
+        while(l < outer && cnt[l] > ntx->loopBound.w[l]) {
+            cnt[l++] = 0;
+            if(l < outer)
+                cnt[l]++;
+        }
+        if(l >= outer)
+            break;
+    }
+
+    // leave the state as the loop nest would
+    ntx->csAccuState = acc[(nOut0 - 1) % tile].cs;
+    for(uint32_t o=0; o < C_N_AGUS; o++) {
+        char * ptr = (char*)ntx->aguOff[o];
+        for(uint32_t l=0; l < outer; l++)
+            ptr += eff[o][l] * ntx->loopBound.w[l];
+        ntx->agu[o] = ptr;
+    }
+
+    return true;
 }
 
+template <bool RELU>
 void
-nstMacOp::store() {
+nstMacOp<RELU>::store() {
 
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
     // call the bittrue model
-    pcsMac (C_FP32_ZERO_VAL,
-            C_FP32_ZERO_VAL,
-            0,
-            0,
-            1,
-            ntx->accuState,
-            (*res));
+    pcsMacT<false, true> (C_FP32_ZERO_VAL,
+                          C_FP32_ZERO_VAL,
+                          0,
+                          ntx->csAccuState,
+                          (*res));
 
     // apply ReLu if required
-    if(ntx->auxFunc && fp32_getSign((*res))) {
+    if(RELU && fp32_getSign((*res))) {
         (*res) = C_FP32_ZERO_VAL;
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_MAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
@@ -355,134 +1891,196 @@ nstMacOp::store() {
 // vector addition, subtraction and multiply
 ///////////////////////////////////////////////////////////////////////////////
 
+template <bool RELU>
 void
-nstVAddSubOp::init() {
+nstVAddSubOp<RELU>::init() {
     if(ntx->initSel >= 3) {
-        ntx->accuState.clear();
-#if NTX_DEBUG_LEVEL > 1
-        printf("NTX_ADDSUB: init accu with zero\n");
-#endif
+        ntx->csAccuState.clear();
+        NTX_TRACE_CMD(C_NTX_TRACE_INIT_ZERO, 0, 0, 0, 0);
     }
     else {
         uint32_t * res = (uint32_t *)ntx->agu[ntx->initSel];
-        pcsMac ((*res),
-                C_FP32_ONE_VAL,
-                1,
-                ntx->polarity,
-                0,
-                ntx->accuState,
-                (*res));
-#if NTX_DEBUG_LEVEL > 1
-        printf("init accu with res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-#endif
+        pcsMacT<true, false> ((*res),
+                              C_FP32_ONE_VAL,
+                              ntx->polarity,
+                              ntx->csAccuState,
+                              (*res));
+        NTX_TRACE_CMD(C_NTX_TRACE_INIT_ACCU, 0, *res, 0, 0);
     }
 
-#if NTX_DEBUG_LEVEL > 1
-            printf("op: NTX_ADDSUB (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
-
 }
 
+template <bool RELU>
 void
-nstVAddSubOp::execute() {
+nstVAddSubOp<RELU>::execute() {
     uint32_t res;
     uint32_t * opA = (uint32_t *)ntx->agu[0];
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opA = %f\n",fp32ToFloat(*opA));
-    printf("op: NTX_VADDSUB (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_A, *opA, 0, 0);
 
     // call the bittrue model
-    pcsMac ((*opA),
-            C_FP32_ONE_VAL,
-            0,
-            0,
-            0,
-            ntx->accuState,
-            res);
+    pcsMacT<false, false> ((*opA),
+                           C_FP32_ONE_VAL,
+                           0,
+                           ntx->csAccuState,
+                           res);
+}
+
+template <bool RELU>
+bool
+nstVAddSubOp<RELU>::executeRow(uint32_t n) {
+
+    static const uint32_t one = C_FP32_ONE_VAL;
+
+    if(ntx->innerLevel > 0) {
+        // call the bittrue model on the whole row, opB is constant
+        pcsMacDot ((uint32_t *)ntx->agu[0],
+                   ntx->aguStride[0][0],
+                   &one,
+                   0,
+                   n,
+                   0,
+                   ntx->csAccuState);
+
+        return true;
+    }
+
+    // element-wise addition, with init and store in every iteration
+    if(ntx->initLevel > 0 || !rowIsAliasFree(n))
+        return false;
+
+    fp32_accuType accu[C_NTX_ROW_CHUNK];
+    const char * opA  = (const char *)ntx->agu[0];
+    const char * init = (const char *)ntx->agu[ntx->initSel & 0x3];
+    char *       res  = (char *)ntx->agu[2];
+    uint32_t     tmp;
+
+    for(uint32_t k=0; k<n; k+=C_NTX_ROW_CHUNK) {
+        const uint32_t len = std::min(n-k, (uint32_t)C_NTX_ROW_CHUNK);
+
+        for(uint32_t j=0; j<len; j++) {
+            if(ntx->initSel >= 3) {
+                accu[j].clear();
+            } else {
+                pcsMacT<true, false> (*(const uint32_t *)init,
+                                      C_FP32_ONE_VAL,
+                                      ntx->polarity,
+                                      accu[j],
+                                      tmp);
+                init += ntx->aguStride[ntx->initSel][0];
+            }
+
+            pcsMacT<false, false> (*(const uint32_t *)opA,
+                                   C_FP32_ONE_VAL,
+                                   0,
+                                   accu[j],
+                                   tmp);
+            opA += ntx->aguStride[0][0];
+        }
+
+        storeRow<RELU>(accu, len, res);
+
+        // keep the state of the last iteration
+        if(k+len == n)
+            pcsToCs(accu[len-1], ntx->csAccuState);
+    }
+
+    return true;
 }
 
+template <bool RELU>
 void
-nstVAddSubOp::store() {
+nstVAddSubOp<RELU>::store() {
 
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
     // call the bittrue model
-    pcsMac (C_FP32_ZERO_VAL,
-            C_FP32_ZERO_VAL,
-            0,
-            0,
-            1,
-            ntx->accuState,
-            (*res));
+    pcsMacT<false, true> (C_FP32_ZERO_VAL,
+                          C_FP32_ZERO_VAL,
+                          0,
+                          ntx->csAccuState,
+                          (*res));
 
     // apply ReLu if required
-    if(ntx->auxFunc && fp32_getSign((*res))) {
+    if(RELU && fp32_getSign((*res))) {
         (*res) = C_FP32_ZERO_VAL;
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_VADDSUB (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
 
+template <bool RELU>
 void
-nstVMultOp::init() {
-#if NTX_DEBUG_LEVEL > 1
-    printf("no init\n");
-    printf("op: NTX_VMULT (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+nstVMultOp<RELU>::init() {
+    NTX_TRACE_CMD(C_NTX_TRACE_NO_INIT, 0, 0, 0, 0);
 }
 
+template <bool RELU>
 void
-nstVMultOp::execute() {
+nstVMultOp<RELU>::execute() {
 
-    uint32_t res;
     uint32_t * opA = (uint32_t *)ntx->agu[0];
     uint32_t * opB = (uint32_t *)ntx->agu[1];
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opA = %f, opB = %f\n",fp32ToFloat(*opA),fp32ToFloat(*opB));
-    printf("op: NTX_VMULT (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_A | C_NTX_TRACE_FETCH_B, *opA, *opB, 0);
 
-    // call the bittrue model
-    pcsMac ((*opA),
-            (*opB),
-            1,
-            ntx->polarity,
-            0,
-            ntx->accuState,
-            res);
+    // call the bittrue model (single product, no accumulation)
+    ntx->prodState = pcsMul((*opA),
+                            (*opB),
+                            ntx->polarity);
+}
+
+template <bool RELU>
+bool
+nstVMultOp<RELU>::executeRow(uint32_t n) {
+
+    // only the element-wise case is batched
+    if(ntx->innerLevel > 0)
+        return false;
+
+    // each result is written right after its operands have been read, as in
+    // the per iteration path, so aliasing needs no special treatment here.
+    const char * opA = (const char *)ntx->agu[0];
+    const char * opB = (const char *)ntx->agu[1];
+    char *       res = (char *)ntx->agu[2];
+
+    for(uint32_t k=0; k<n; k++) {
+        fp32 tmp = pcsMul(*(const uint32_t *)opA,
+                          *(const uint32_t *)opB,
+                          ntx->polarity);
+
+        ntx->prodState = tmp;
+
+        // apply ReLu if required
+        if(RELU && fp32_getSign(tmp))
+            tmp = C_FP32_ZERO_VAL;
+
+        *(uint32_t *)res = tmp;
+
+        opA += ntx->aguStride[0][0];
+        opB += ntx->aguStride[1][0];
+        res += ntx->aguStride[2][0];
+    }
+
+    return true;
 }
 
+template <bool RELU>
 void
-nstVMultOp::store() {
+nstVMultOp<RELU>::store() {
 
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
-    // call the bittrue model
-    pcsMac (C_FP32_ZERO_VAL,
-            C_FP32_ZERO_VAL,
-            0,
-            0,
-            1,
-            ntx->accuState,
-            (*res));
+    (*res) = ntx->prodState;
 
     // apply ReLu if required
-    if(ntx->auxFunc && fp32_getSign((*res))) {
+    if(RELU && fp32_getSign((*res))) {
         (*res) = C_FP32_ZERO_VAL;
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_VMULT (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
@@ -491,8 +2089,9 @@ nstVMultOp::store() {
 // outer products
 ///////////////////////////////////////////////////////////////////////////////
 
+template <bool RELU>
 void
-nstOuterPOp::init() {
+nstOuterPOp<RELU>::init() {
     if(ntx->initSel >= 3) {
         ntx->aluState = C_FP32_ZERO_VAL;
     }
@@ -501,59 +2100,85 @@ nstOuterPOp::init() {
     }
 
     // clear accu
-    ntx->accuState.clear();
+    ntx->prodState = C_FP32_ZERO_VAL;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("init accu with %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-    printf("op: NTX_OUTERP (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_INIT_ACCU, 0, ntx->aluState, 0, 0);
 
 }
 
+template <bool RELU>
 void
-nstOuterPOp::execute() {
+nstOuterPOp<RELU>::execute() {
 
     uint32_t * opA = (uint32_t *)ntx->agu[0];
-    uint32_t res;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opA = %f (0x%08X)\n",fp32ToFloat(*opA), *opA);
-    printf("op: NTX_OUTERP (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_A, *opA, 0, 0);
 
-    // call the bittrue model
-    pcsMac ((*opA),
-            ntx->aluState,
-            1,
-            ntx->polarity,
-            0,
-            ntx->accuState,
-            res);
+    // call the bittrue model (single product, no accumulation)
+    ntx->prodState = pcsMul((*opA),
+                            ntx->aluState,
+                            ntx->polarity);
+}
+
+template <bool RELU>
+bool
+nstOuterPOp<RELU>::executeRow(uint32_t n) {
+
+    // only the element-wise case is batched
+    if(ntx->innerLevel > 0)
+        return false;
+
+    // same order of loads and stores as the per iteration path, see
+    // nstVMultOp::executeRow
+    const char * opA  = (const char *)ntx->agu[0];
+    const char * init = (const char *)ntx->agu[ntx->initSel & 0x3];
+    char *       res  = (char *)ntx->agu[2];
+
+    for(uint32_t k=0; k<n; k++) {
+        // the alu state is reloaded in every iteration if init is
+        // in the innermost loop
+        if(ntx->initLevel == 0) {
+            if(ntx->initSel >= 3) {
+                ntx->aluState = C_FP32_ZERO_VAL;
+            } else {
+                ntx->aluState = *(const uint32_t *)init;
+                init += ntx->aguStride[ntx->initSel][0];
+            }
+        }
+
+        fp32 tmp = pcsMul(*(const uint32_t *)opA,
+                          ntx->aluState,
+                          ntx->polarity);
+
+        ntx->prodState = tmp;
+
+        // apply ReLu if required
+        if(RELU && fp32_getSign(tmp))
+            tmp = C_FP32_ZERO_VAL;
+
+        *(uint32_t *)res = tmp;
+
+        opA += ntx->aguStride[0][0];
+        res += ntx->aguStride[2][0];
+    }
+
+    return true;
 }
 
+template <bool RELU>
 void
-nstOuterPOp::store() {
+nstOuterPOp<RELU>::store() {
 
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
-    // call the bittrue model
-    pcsMac (C_FP32_ZERO_VAL,
-            C_FP32_ZERO_VAL,
-            0,
-            0,
-            1,
-            ntx->accuState,
-            (*res));
+    (*res) = ntx->prodState;
 
     // apply ReLu if required
-    if(ntx->auxFunc && fp32_getSign((*res))) {
+    if(RELU && fp32_getSign((*res))) {
         (*res) = C_FP32_ZERO_VAL;
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_OUTERP (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
@@ -561,8 +2186,9 @@ nstOuterPOp::store() {
 // (A)MAX and (A)MIN
 ///////////////////////////////////////////////////////////////////////////////
 
+template <bool ARG>
 void
-nstMaxMinOp::init() {
+nstMaxMinOp<ARG>::init() {
     if(ntx->initSel >= 3) {
         ntx->aluState = C_FP32_ZERO_VAL;
     }
@@ -572,21 +2198,16 @@ nstMaxMinOp::init() {
 
     ntx->cntState = 0;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("init accu with %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-    printf("op: NTX_MAXMIN (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_INIT_ACCU, 0, ntx->aluState, 0, 0);
 
 }
 
+template <bool ARG>
 void
-nstMaxMinOp::execute() {
+nstMaxMinOp<ARG>::execute() {
     uint32_t * opB = (uint32_t *)ntx->agu[1];
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opB = %f (0x%08X)\n",fp32ToFloat(*opB), *opB);
-    printf("op: NTX_MAXMIN (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_B, 0, *opB, 0);
     // negative polarity means MIN
     bool tst = (fp32ToFloat(ntx->aluState) > fp32ToFloat(*opB)) ^ !ntx->polarity;
 
@@ -598,21 +2219,41 @@ nstMaxMinOp::execute() {
     ntx->cntState++;
 }
 
+template <bool ARG>
+bool
+nstMaxMinOp<ARG>::executeRow(uint32_t n) {
+
+    // only rows within the window of one output are batched
+    if(ntx->initLevel == 0 || ntx->innerLevel == 0 ||
+       ntx->aguStride[1][0] != sizeof(uint32_t))
+        return false;
+
+    if(!nstMaxMinRowImpl((const uint32_t *)ntx->agu[1],
+                         n,
+                         ntx->polarity,
+                         ntx->aluState,
+                         ntx->idxState,
+                         ntx->cntState))
+        return false;
+
+    ntx->cntState += n;
+
+    return true;
+}
+
+template <bool ARG>
 void
-nstMaxMinOp::store() {
+nstMaxMinOp<ARG>::store() {
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
-    if(ntx->auxFunc) {
+    if(ARG) {
         *res = ntx->idxState;
     }
     else {
         *res = ntx->aluState;
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_MAXMIN (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
@@ -621,8 +2262,9 @@ nstMaxMinOp::store() {
 // THTST
 ///////////////////////////////////////////////////////////////////////////////
 
+template <uint8_t AUX>
 void
-nstThTstOp::init() {
+nstThTstOp<AUX>::init() {
     if(ntx->initSel >= 3) {
         ntx->aluState = C_FP32_ZERO_VAL;
     }
@@ -630,51 +2272,72 @@ nstThTstOp::init() {
         ntx->aluState = *(uint32_t *)ntx->agu[ntx->initSel];
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("init alu with %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-    printf("op: NTX_THTST (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_INIT_ALU, 0, ntx->aluState, 0, 0);
 
 }
 
+template <uint8_t AUX>
 void
-nstThTstOp::execute() {
+nstThTstOp<AUX>::execute() {
 
     opB = (uint32_t *)ntx->agu[1];
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opB = %f (0x%08X)\n",fp32ToFloat(*opB), *opB);
-    printf("op: NTX_THTST (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_B, 0, *opB, 0);
 
-    switch(ntx->auxFunc & 0x3) {
-        case C_NTX_THTST_AUX_CMP_EQ:
-            tst = (fp32ToFloat(ntx->aluState) == fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_MASK_AUX_CMP_LT:
-            tst = (fp32ToFloat(ntx->aluState) > fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_THTST_AUX_CMP_LE:
-            tst = (fp32ToFloat(ntx->aluState) >= fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        default:
-            tst = 0;
-            break;
+    // the counter mode does not exist here, mode 3 never passes
+    tst = nstCompare<(AUX & 0x3)>(ntx, *opB);
+}
+
+template <uint8_t AUX>
+bool
+nstThTstOp<AUX>::executeRow(uint32_t n) {
+
+    static const uint32_t one  = C_FP32_ONE_VAL;
+    static const uint32_t zero = C_FP32_ZERO_VAL;
+
+    // only the element-wise case is batched
+    if(ntx->innerLevel > 0 || !rowIsAliasFree(n))
+        return false;
+
+    nstSelectRow r;
+    if(!rowAluSrc(r.a) || !rowSrc(1, r.b) || ntx->aguStride[2][0] != sizeof(uint32_t))
+        return false;
+
+    if(AUX & C_NTX_THTST_AUX_BIN_OUT) {
+        r.x = {&one,  false};
+        r.y = {&zero, false};
+    } else {
+        r.x = r.b;
+        r.y = r.a;
     }
+    r.res      = (uint32_t *)ntx->agu[2];
+    r.n        = n;
+    r.cmp      = AUX & 0x3;
+    r.polarity = ntx->polarity;
+    r.cnt      = 0;
+    r.cntVec   = false;
+
+    rowAluLatch(r.a, n);
+
+    nstSelectRowImpl(r);
+
+    return true;
+}
+
+// tst and opB are overwritten in every iteration
+template <uint8_t AUX>
+bool
+nstThTstOp<AUX>::executeNest() {
+    return executeLastIters(*this, false);
 }
 
+template <uint8_t AUX>
 void
-nstThTstOp::store() {
+nstThTstOp<AUX>::store() {
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
     // binary output
-    if(ntx->auxFunc & 0x4){
+    if(AUX & C_NTX_THTST_AUX_BIN_OUT){
         *res = tst ? C_FP32_ONE_VAL : C_FP32_ZERO_VAL;
     }
     // thresholding output
@@ -682,10 +2345,7 @@ nstThTstOp::store() {
         *res = tst ? *opB : ntx->aluState;
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_THTST (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
@@ -693,8 +2353,9 @@ nstThTstOp::store() {
 // conditional masking operation
 ///////////////////////////////////////////////////////////////////////////////
 
+template <uint8_t AUX>
 void
-nstMaskOp::init() {
+nstMaskOp<AUX>::init() {
     if(ntx->initSel >= 3) {
         ntx->aluState = C_FP32_ZERO_VAL;
     }
@@ -704,58 +2365,76 @@ nstMaskOp::init() {
 
     ntx->cntState = 0;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("init alu with %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-    printf("op: NTX_MASK (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_INIT_ALU, 0, ntx->aluState, 0, 0);
 
 }
 
+template <uint8_t AUX>
 void
-nstMaskOp::execute() {
+nstMaskOp<AUX>::execute() {
 
     opA = (uint32_t *)ntx->agu[0];
     uint32_t * opB = (uint32_t *)ntx->agu[1];
 
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opB = %f (0x%08X)\n",fp32ToFloat(*opB), *opB);
-    printf("op: NTX_MASK (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_B, 0, *opB, 0);
 
 
-    switch(ntx->auxFunc) {
-        case C_NTX_THTST_AUX_CMP_EQ:
-            tst = (fp32ToFloat(ntx->aluState) == fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_MASK_AUX_CMP_LT:
-            tst = (fp32ToFloat(ntx->aluState) > fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_THTST_AUX_CMP_LE:
-            tst = (fp32ToFloat(ntx->aluState) >= fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_THTST_AUX_BIN_OUT:
-            // compare with counter
-            tst = ntx->cntState == ntx->aluState;
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        default:
-            tst = 0;
-            break;
-    }
+    tst = nstCompare<AUX>(ntx, *opB);
 
     ntx->cntState++;
 }
 
+template <uint8_t AUX>
+bool
+nstMaskOp<AUX>::executeRow(uint32_t n) {
+
+    static const uint32_t zero = C_FP32_ZERO_VAL;
+
+    // only the element-wise case is batched
+    if(ntx->innerLevel > 0 || !rowIsAliasFree(n))
+        return false;
+
+    nstSelectRow r;
+    if(!rowAluSrc(r.a) || !rowSrc(0, r.x) || ntx->aguStride[2][0] != sizeof(uint32_t))
+        return false;
+
+    // opB is not used by the counter mode
+    if(AUX == C_NTX_MASK_AUX_CMP_CNT)
+        r.b = r.a;
+    else if(!rowSrc(1, r.b))
+        return false;
+
+    // the counter is reset by init
+    const bool reInit = ntx->initLevel == 0;
+
+    r.y        = {&zero, false};
+    r.res      = (uint32_t *)ntx->agu[2];
+    r.n        = n;
+    r.cmp      = AUX;
+    r.polarity = ntx->polarity;
+    r.cnt      = reInit ? 0 : ntx->cntState;
+    r.cntVec   = !reInit;
+
+    rowAluLatch(r.a, n);
+
+    nstSelectRowImpl(r);
+
+    ntx->cntState = reInit ? 1 : ntx->cntState + n;
+
+    return true;
+}
+
+// tst and opA are overwritten in every iteration, only the counter advances
+template <uint8_t AUX>
+bool
+nstMaskOp<AUX>::executeNest() {
+    return executeLastIters(*this, true);
+}
+
+template <uint8_t AUX>
 void
-nstMaskOp::store() {
+nstMaskOp<AUX>::store() {
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
 
@@ -763,10 +2442,7 @@ nstMaskOp::store() {
     *res = tst ? *opA : C_FP32_ZERO_VAL;
 
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_MASK (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
@@ -775,8 +2451,9 @@ nstMaskOp::store() {
 // masked mac operation
 ///////////////////////////////////////////////////////////////////////////////
 
+template <uint8_t AUX>
 void
-nstMaskMacOp::init() {
+nstMaskMacOp<AUX>::init() {
 
     // load two values
     if(ntx->initSel >= 3) {
@@ -787,103 +2464,61 @@ nstMaskMacOp::init() {
     }
 
     uint32_t * res = (uint32_t *)ntx->agu[0];
-    pcsMac ((*res),
-            C_FP32_ONE_VAL,
-            1,
-            0,
-            0,
-            ntx->accuState,
-            (*res));
+    pcsMacT<true, false> ((*res),
+                          C_FP32_ONE_VAL,
+                          0,
+                          ntx->maskAccuState,
+                          (*res));
 
     ntx->cntState = 0;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("init alu with %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-    printf("init accu with %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_MASKMAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_INIT_ALU, 1, ntx->aluState, *res, 0);
 
 }
 
+template <uint8_t AUX>
 void
-nstMaskMacOp::execute() {
+nstMaskMacOp<AUX>::execute() {
 
     // load read-modify-write vector (result)
     opA = (uint32_t *)ntx->agu[2];
 
     uint32_t * opB = opA;
-    if(!(ntx->auxFunc & 0x4)) {
+    if(!(AUX & C_NTX_MASK_AUX_CMP_CNT)) {
 
         opB = (uint32_t *)ntx->agu[1];
 
-#if NTX_DEBUG_LEVEL > 1
-        printf("fetching: opB = %f (0x%08X)\n",fp32ToFloat(*opB), *opB);
-#endif
+        NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_B, 0, *opB, 0);
     }
 
-    switch(ntx->auxFunc) {
-        case C_NTX_THTST_AUX_CMP_EQ:
-            tst = (fp32ToFloat(ntx->aluState) == fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_MASK_AUX_CMP_LT:
-            tst = (fp32ToFloat(ntx->aluState) > fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_THTST_AUX_CMP_LE:
-            tst = (fp32ToFloat(ntx->aluState) >= fp32ToFloat(*opB));
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        case C_NTX_THTST_AUX_BIN_OUT:
-            // compare with counter
-            tst = ntx->cntState == ntx->aluState;
-            // invert if necessary
-            tst ^=  ntx->polarity;
-            break;
-        default:
-            tst = 0;
-            break;
-    }
+    tst = nstCompare<AUX>(ntx, *opB);
 
     ntx->cntState++;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("fetching: opA = %f (0x%08X)\n",fp32ToFloat(*opA), *opA);
-    printf("op: NTX_MASKMAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_A, *opA, 0, 0);
 
 }
 
+template <uint8_t AUX>
 void
-nstMaskMacOp::store() {
+nstMaskMacOp<AUX>::store() {
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
 
     // conditionally accumulate and WB
     if(tst) {
         // call the bittrue model
-        pcsMac ((*opA),
-                C_FP32_ONE_VAL,
-                0,
-                0,
-                1,
-                ntx->accuState,
-                (*res));
-
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_MASKMAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+        pcsMacT<false, true> ((*opA),
+                              C_FP32_ONE_VAL,
+                              0,
+                              ntx->maskAccuState,
+                              (*res));
+
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
     }
     else {
-#if NTX_DEBUG_LEVEL > 1
-    printf("not storing since comparison returned false\n");
-    printf("op: NTX_MASKMAC (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_NO_STORE, 0, 0, 0, 0);
     }
 
 }
@@ -893,10 +2528,11 @@ nstMaskMacOp::store() {
 // copy operation
 ///////////////////////////////////////////////////////////////////////////////
 
+template <bool VECT>
 void
-nstCopyOp::init() {
+nstCopyOp<VECT>::init() {
 
-    if(!(ntx->auxFunc & 0x1)) {
+    if(!VECT) {
         if(ntx->initSel >= 3) {
             ntx->aluState = C_FP32_ZERO_VAL;
         }
@@ -905,41 +2541,191 @@ nstCopyOp::init() {
         }
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("init alu with %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-    printf("op: NTX_COPY");
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_INIT_ALU, 0, ntx->aluState, 0, 0);
 
 }
 
+template <bool VECT>
 void
-nstCopyOp::execute() {
+nstCopyOp<VECT>::execute() {
 
-    if(ntx->auxFunc & 0x1) {
+    if(VECT) {
         ntx->aluState = *(uint32_t *)ntx->agu[0];
 
-#if NTX_DEBUG_LEVEL > 1
-        printf("fetching: aluState = %f (0x%08X)\n",fp32ToFloat(ntx->aluState), ntx->aluState);
-#endif
+        NTX_TRACE_CMD(C_NTX_TRACE_FETCH, C_NTX_TRACE_FETCH_ALU, 0, 0, ntx->aluState);
 
     }
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("op: NTX_COPY (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+}
+
+template <bool VECT>
+bool
+nstCopyOp<VECT>::executeRow(uint32_t n) {
+
+    // only the element-wise case is batched
+    if(ntx->innerLevel > 0 || !rowIsAliasFree(n))
+        return false;
+
+    // the value that is stored, the copy never tests
+    nstSelectRow r;
+    if(VECT) {
+        if(!rowSrc(0, r.y))
+            return false;
+    } else if(!rowAluSrc(r.y)) {
+        return false;
+    }
+    if(ntx->aguStride[2][0] != sizeof(uint32_t))
+        return false;
+
+    r.a        = r.y;
+    r.b        = r.y;
+    r.x        = r.y;
+    r.res      = (uint32_t *)ntx->agu[2];
+    r.n        = n;
+    r.cmp      = C_NTX_ROW_CMP_NEVER;
+    r.polarity = false;
+    r.cnt      = 0;
+    r.cntVec   = false;
+
+    if(VECT)
+        ntx->aluState = r.y.ptr[r.y.vec ? n-1 : 0];
+    else
+        rowAluLatch(r.y, n);
+
+    nstSelectRowImpl(r);
+
+    return true;
+}
 
+// the replicate mode does not execute anything, and the vector mode
+// overwrites aluState in every iteration, so only the last copy of a window
+// is stored. if the nest stores in every iteration, it is lowered to memcpy,
+// memmove or strided copies (vector mode, and replicate mode with init in
+// the innermost loop), or to fills (replicate mode).
+template <bool VECT>
+bool
+nstCopyOp<VECT>::executeNest() {
+
+    if(ntx->innerLevel > 0)
+        return executeLastIters(*this, false);
+
+    const uint32_t outer = ntx->outerLevel;
+
+    int64_t eff[C_N_AGUS][C_N_HW_LOOPS];
+    nstEffStrides(ntx, eff);
+
+    // copies walk the whole nest at once, fills are repeated after each
+    // init (zero fills only once). o is the source of the copies.
+    const bool     fill = !VECT && (ntx->initLevel > 0 || ntx->initSel >= 3);
+    const uint32_t o    = VECT ? 0 : ntx->initSel;
+    const uint32_t top  = (fill && ntx->initSel < 3) ? ntx->initLevel : outer;
+
+    nstCopyDims d;
+    nstCopyCollapse(ntx, eff, top, fill ? 2 : o, d);
+
+    const int64_t rowDst = d.dst[0];
+    const int64_t rowSrc = d.src[0];
+    const size_t  rowLen = d.len[0];
+
+    if(fill) {
+        auto row = [&](char * dst, const char *) {
+            const uint32_t val = ntx->aluState;
+            if(rowDst == sizeof(uint32_t) && val == 0) {
+                memset(dst, 0, rowLen * sizeof(uint32_t));
+            } else if(rowDst == sizeof(uint32_t)) {
+                std::fill_n((uint32_t *)dst, rowLen, val);
+            } else {
+                for(size_t k=0; k < rowLen; k++)
+                    *(uint32_t *)(dst + rowDst * (int64_t)k) = val;
+            }
+        };
+
+        // the init values are loaded one after the other, as they may
+        // have been overwritten by an earlier fill
+        uint32_t cnt[C_N_HW_LOOPS] = {0};
+        for(;;) {
+            for(uint32_t a=0; a < C_N_AGUS; a++) {
+                char * ptr = (char*)ntx->aguOff[a];
+                for(uint32_t l=top; l < outer; l++)
+                    ptr += eff[a][l] * cnt[l];
+                ntx->agu[a] = ptr;
+            }
+            init();
+            nstCopyWalk(d, (char*)ntx->agu[2], nullptr, row);
+
+            uint32_t l = top;
+            while(l < outer && cnt[l] == ntx->loopBound.w[l])
+                cnt[l++] = 0;
+            if(l == outer)
+                break;
+            cnt[l]++;
+        }
+    } else {
+        int64_t srcLo, srcHi, dstLo, dstHi;
+        nstAguRange(ntx, eff, o, srcLo, srcHi);
+        nstAguRange(ntx, eff, 2, dstLo, dstHi);
+
+        bool inPlace = ntx->aguOff[o] == ntx->aguOff[2];
+        for(uint32_t l=0; l < outer; l++)
+            inPlace &= eff[o][l] == eff[2][l];
+
+        const bool disjoint = (srcHi + (int64_t)sizeof(uint32_t) <= dstLo) ||
+                              (dstHi + (int64_t)sizeof(uint32_t) <= srcLo);
+
+        // an overlapping copy of a single row in the same direction is a
+        // memmove, if every word is read before it is overwritten
+        const int64_t src = (int64_t)(intptr_t)ntx->aguOff[o];
+        const int64_t dst = (int64_t)(intptr_t)ntx->aguOff[2];
+        const bool    move = d.nDims == 1 && rowDst == rowSrc &&
+                             std::abs(rowDst) == sizeof(uint32_t) &&
+                             (rowDst > 0 ? dst <= src : dst >= src);
+
+        if(inPlace) {
+            // nothing changes
+        } else if(move) {
+            memmove((char *)(intptr_t)dstLo, (const char *)(intptr_t)srcLo,
+                    rowLen * sizeof(uint32_t));
+        } else if(disjoint) {
+            auto row = [&](char * dst, const char * src) {
+                if(rowDst == sizeof(uint32_t) && rowSrc == sizeof(uint32_t)) {
+                    memcpy(dst, src, rowLen * sizeof(uint32_t));
+                } else {
+                    for(size_t k=0; k < rowLen; k++)
+                        *(uint32_t *)(dst + rowDst * (int64_t)k) =
+                            *(const uint32_t *)(src + rowSrc * (int64_t)k);
+                }
+            };
+            if(nstCopyIsTransposed(d)) {
+                nstCopyTransposed(d, (char*)ntx->aguOff[2], (const char*)ntx->aguOff[o]);
+            } else {
+                nstCopyWalk(d, (char*)ntx->aguOff[2], (const char*)ntx->aguOff[o], row);
+            }
+        } else {
+            return false;
+        }
+    }
+
+    // leave the state as the loop nest would. the last iteration stores
+    // aluState.
+    for(uint32_t a=0; a < C_N_AGUS; a++) {
+        char * ptr = (char*)ntx->aguOff[a];
+        for(uint32_t l=0; l < outer; l++)
+            ptr += eff[a][l] * ntx->loopBound.w[l];
+        ntx->agu[a] = ptr;
+    }
+    ntx->aluState = *(uint32_t *)ntx->agu[2];
+
+    return true;
 }
 
+template <bool VECT>
 void
-nstCopyOp::store() {
+nstCopyOp<VECT>::store() {
     uint32_t * res = (uint32_t *)ntx->agu[2];
 
     *res = ntx->aluState;
 
-#if NTX_DEBUG_LEVEL > 1
-    printf("storing: res = %f (0x%08X)\n",fp32ToFloat(*res), *res);
-    printf("op: NTX_COPY (init: 0x%X, polarity: %u, auxFunc: %X)\n", ntx->initSel, ntx->polarity, ntx->auxFunc);
-#endif
+    NTX_TRACE_CMD(C_NTX_TRACE_STORE, 0, *res, 0, 0);
 
 }
 
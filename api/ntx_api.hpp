@@ -23,11 +23,12 @@
 #include <initializer_list>
 #include <cassert>
 
-// enables some debug output
-#ifndef NTX_DEBUG_LEVEL
-#define NTX_DEBUG_LEVEL          0
+#ifdef NTX_EMULATION_ON
+#include <memory>
 #endif
 
+// trace points are enabled with NTX_TRACE_ON, see ntx_trace.hpp
+
 ///////////////////////////////////////////////////////////////////////////////
 // some constants that are required internally. they must be aligned with
 // the SV and VHDL constants. do not change them unless you know what you
@@ -46,6 +47,7 @@
 #define C_DATA_WIDTH             32
 #define C_BYTE_ENABLE_WIDTH      4
 #define C_NTX_FPU_ALU_CNT_WIDTH  16
+#define C_NST_JOB_FIFO_DEPTH     1
 
 // ntx register map, use nstReadReg
 // note: these are word addresses (gets implicitly
@@ -62,6 +64,7 @@
 
 #define C_NTX_OPCODE_WIDTH       4
 #define C_NTX_LOOP_LEVEL_WIDTH   3
+#define C_NTX_AUX_WIDTH          3
 #define C_N_NTX_OPCODES          9
 #define C_NTX_MAC_OP             0
 #define C_NTX_VADDSUB_OP         1
@@ -127,6 +130,49 @@ typedef arr2D<int32_t, C_N_HW_LOOPS, C_N_AGUS> nst_strideType;
 // NTX job type
 ///////////////////////////////////////////////////////////////////////////////
 
+#ifdef NTX_EMULATION_ON
+
+// job FIFO and worker thread of the asynchronous emulation, see setAsyncMode
+class ntxJobQueue;
+
+// owning handle of the job queue of an NTX. the queue refers to the NTX it
+// belongs to, so it is never shared: a copy of an NTX (also the ones a
+// growing std::vector makes) waits until the NTX is idle and starts in
+// synchronous mode, and an assignment waits until both NTXs are idle and
+// keeps the queue of the target.
+class ntxJobQueueRef {
+    public:
+
+    ntxJobQueueRef() {}
+    ntxJobQueueRef(const ntxJobQueueRef & other);
+    ntxJobQueueRef & operator=(const ntxJobQueueRef & other);
+    ~ntxJobQueueRef();
+
+    void reset(ntxJobQueue * queue_ = nullptr);
+
+    explicit operator bool() const { return queue != nullptr; }
+    ntxJobQueue * operator->() const { return queue; }
+
+    private:
+
+    ntxJobQueue * queue = nullptr;
+};
+
+// cycle model of a cluster of NTXs, see ntx_cluster.hpp
+class ntxCluster;
+class ntxTimingModel;
+
+// timing estimate of a command, see setPerfModel and estimateCmd
+struct ntxPerfEstimate {
+    uint64_t cycles      = 0; // from the start of the command to its last write back
+    uint64_t issueCycles = 0; // until the NTX starts the next command
+    uint64_t steps       = 0; // loop iterations
+    double   utilization = 0; // steps per issue cycle
+    uint64_t endCycle    = 0; // of the last write back, counted from setPerfModel
+};
+
+#endif
+
 
 class ntx_api {
 public:
@@ -138,6 +184,11 @@ public:
     uint32_t loopLevels = 0;
 
 #ifdef NTX_EMULATION_ON
+    // job FIFO, only set in asynchronous mode. it comes before the fields
+    // that the worker writes, so that a copy of the NTX waits until the
+    // worker is done before it copies them (see ntxJobQueueRef).
+    ntxJobQueueRef jobQueue;
+
     // for sanity checks only
     aguPtrType tcdmLow  = nullptr;
     aguPtrType tcdmHigh = nullptr;
@@ -160,12 +211,25 @@ public:
     nst_aguType    aguOff;
     nst_strideType aguStride;
 
-    // ntx state
+    // ntx state. there is no common accumulator: MAC and VADDSUB
+    // accumulate in csAccuState (see csToPcs), MASKMAC in maskAccuState,
+    // and VMULT and OUTERP keep their normalized product in prodState.
     nst_aguType    agu;
-    fp32_accuType  accuState;
+    fp32_accuType  maskAccuState; // accumulator of MASKMAC
+    fp32_csAccuType csAccuState; // used by the long accumulation chains of MAC and VADDSUB
     uint32_t       aluState = 0;
+    uint32_t       prodState = 0; // normalized single product of VMULT and OUTERP
     uint32_t       cntState = 0;
     uint32_t       idxState = 0;
+
+    // TCDM priority, and the cluster that records the issued commands (only
+    // used by the cycle model in ntx_cluster.hpp)
+    uint8_t     tcdmPrio = C_NTX_CTRL_PRIO_HI;
+    ntxCluster *cluster  = nullptr;
+
+    // timing estimate of the last issued command, see setPerfModel
+    ntxPerfEstimate lastPerf;
+    std::shared_ptr<ntxTimingModel> perfModel;
 #endif
 
     // broadcast
@@ -275,14 +339,14 @@ public:
     inline bool
     isIdle() {
         assert(!broadcast);
-        return true;
+        return !jobQueue || queueIsIdle();
     }
 
     // checks whether the NTX can accept another command
     inline bool
     isReady() {
         assert(!broadcast);
-        return true;
+        return !jobQueue || queueIsReady();
     }
 
     // checks whether the NTX has halted due to an invalid command
@@ -294,20 +358,26 @@ public:
     // set the TCDM priority of the NTX
     inline void
     setTcdmPrio(uint32_t val) {
+        if (broadcast) {
+            for (auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
+                ntx->setTcdmPrio(val);
+            return;
+        }
+        tcdmPrio = val & 0x6;
     }
 
     // get the TCDM priority of the NTX
     inline uint32_t
     getTcdmPrio() {
         assert(!broadcast);
-        return 0;
+        return tcdmPrio;
     }
 
     // check if there is a pending interrupt
     inline bool
     hasIrq() {
         assert(!broadcast);
-        return irqReg;
+        return jobQueue ? queueHasIrq() : irqReg;
     }
 
     // clears all pending IRQs
@@ -318,6 +388,10 @@ public:
                 ntx->clrIrq();
             return;
         }
+        if (jobQueue) {
+            queueClrIrq();
+            return;
+        }
         irqReg = false;
     }
 
@@ -326,11 +400,33 @@ public:
 
     inline void
     idleWait() {
+        #ifdef NTX_EMULATION_ON
+        if (broadcast) {
+            for (auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
+                ntx->idleWait();
+            return;
+        }
+        if (jobQueue) {
+            queueWait(true);
+            return;
+        }
+        #endif
         while(!isIdle());
     }
 
     inline void
     readyWait() {
+        #ifdef NTX_EMULATION_ON
+        if (broadcast) {
+            for (auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
+                ntx->readyWait();
+            return;
+        }
+        if (jobQueue) {
+            queueWait(false);
+            return;
+        }
+        #endif
         while(!isReady());
     }
 
@@ -522,12 +618,23 @@ public:
     }
 
 
+    /// triggers the staged command. in emulation, the command is executed
+    /// right away, or handed to the worker thread in asynchronous mode (see
+    /// setAsyncMode). it does not allocate memory apart from starting the
+    /// thread pool on first use (see nstFuncModel), from recording the
+    /// command if the NTX is part of an ntxCluster, and from the first
+    /// command after setPerfModel.
     inline void
     issueCmd() {
         #ifdef NTX_EMULATION_ON
         if (broadcast) {
-            for (auto ntx = broadcast; ntx != broadcastEnd; ++ntx)
-                ntx->issueCmd();
+            issueBroadcast();
+            return;
+        }
+        if (cluster || perfModel)
+            recordCmd();
+        if (jobQueue) {
+            queuePush();
             return;
         }
         nstFuncModel();
@@ -550,6 +657,58 @@ public:
         checkTcdmAddrs = true;
     }
 
+    // in asynchronous mode, issued commands are executed by a worker thread
+    // of this NTX, while the host continues. like in HW, the job FIFO holds
+    // C_NST_JOB_FIFO_DEPTH commands besides the one being executed, and
+    // isReady/isIdle/hasIrq report the state of the FIFO and the worker.
+    // issueCmd blocks while the FIFO is full (use readyWait to wait
+    // explicitly), and idleWait/readyWait block without spinning. switching
+    // back to synchronous mode waits until the NTX is idle. copies of the
+    // NTX start in synchronous mode (see ntxJobQueueRef).
+    void
+    setAsyncMode(bool async);
+
+    // queue interface of the asynchronous mode, see setAsyncMode
+    void queuePush();
+    bool queueIsIdle();
+    bool queueIsReady();
+    bool queueHasIrq();
+    void queueClrIrq();
+    void queueWait(bool idle);
+
+    // enables the timing estimates of issued commands. issueCmd then runs
+    // each command on the cycle model of ntx_cluster.hpp, with a TCDM that
+    // has no conflicts, and stores the estimate in lastPerf. the commands
+    // follow each other like with a full job FIFO, so that a command starts
+    // while the FPU still works on the previous one.
+    void
+    setPerfModel(bool on);
+
+    // estimates the staged command on an idle NTX, without issuing it
+    ntxPerfEstimate
+    estimateCmd() const;
+
+    // records the staged command in the cluster of this NTX (see
+    // ntxCluster::simulate) and in the timing estimate
+    void
+    recordCmd();
+
+    // issues the staged commands of all members of a broadcast NTX. the
+    // members run at the same time on the thread pool (see ntx_pool.hpp),
+    // unless one of them stores to an address range that another one
+    // accesses, in which case they run one after the other, as before. if
+    // all members have staged the same command, small groups of them share
+    // the loop control of one loop nest.
+    void
+    issueBroadcast();
+
+    // checks the address range of all AGUs over the whole loop nest of the
+    // staged command against the TCDM bounds set with setTcdmBaseCheck.
+    // reports the AGU and the loop iteration that would leave the TCDM, and
+    // asserts.
+    void
+    checkAguFootprint();
+
     // write a job dump to a txt file
     void
     writeJobDump(
@@ -558,7 +717,11 @@ public:
         const aguPtrType tcdm
     );
 
-    // functional model of the NTX
+    // functional model of the NTX. runs the command staged in this object
+    // without any heap allocation: the op state lives on the stack of the
+    // kernel, and all other state is part of ntx_api. large commands whose
+    // outermost loop iterations are independent are split across the
+    // thread pool (see ntx_pool.hpp).
     void nstFuncModel();
 
     #endif
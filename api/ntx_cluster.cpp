@@ -0,0 +1,526 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <cassert>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_cluster.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// NTX cycle model
+///////////////////////////////////////////////////////////////////////////////
+
+// ops whose results go through the MAC pipeline, the others use the ALU
+static bool
+ntxUsesMac(uint8_t opCode) {
+    return opCode == C_NTX_MAC_OP    || opCode == C_NTX_VADDSUB_OP ||
+           opCode == C_NTX_VMULT_OP  || opCode == C_NTX_OUTERP_OP  ||
+           opCode == C_NTX_MASKMAC_OP;
+}
+
+void
+ntxTimingModel::push(const ntxTimingJob & job) {
+    // drop the jobs that the controller is done with
+    if(state == IDLE && nextJob == jobs.size()) {
+        jobs.clear();
+        nextJob = 0;
+    }
+    jobs.push_back(job);
+}
+
+bool
+ntxTimingModel::drained() const {
+    return fpu.cmdFifo.n == 0 && fpu.outFifo.n == 0 &&
+           fpu.reqFifo[0].n == 0 && fpu.reqFifo[1].n == 0 &&
+           fpu.rdFifo[0].n == 0 && fpu.rdFifo[1].n == 0 &&
+           fpu.opCnt[0] == 0 && fpu.opCnt[1] == 0;
+}
+
+bool
+ntxTimingModel::idle() const {
+    return state == IDLE && nextJob == jobs.size() && drained();
+}
+
+bool
+ntxTimingModel::atBarrier() const {
+    return state == IDLE && nextJob < jobs.size() && jobs[nextJob].barrier && drained();
+}
+
+void
+ntxTimingModel::popBarrier() {
+    assert(atBarrier());
+    nextJob++;
+}
+
+// true in the first iteration of loop level level, i.e. all loops below it
+// are at their start (DagLoopStartTrig)
+bool
+ntxTimingModel::loopStartAt(uint32_t level) const {
+    for(uint32_t l=0; l < level; l++)
+        if(cnt[l] != 0)
+            return false;
+    return true;
+}
+
+// true in the last iteration of loop level level, i.e. all loops below it
+// are at their bounds (DagLoopEndTrig)
+bool
+ntxTimingModel::loopEnd(uint32_t level) const {
+    const ntxTimingJob & j = jobs[curJob];
+    for(uint32_t l=0; l < level; l++)
+        if(cnt[l] != j.loopBound[l])
+            return false;
+    return true;
+}
+
+// moves the AGUs to the next iteration. the strides are staged in the
+// incremental formulation, so only the stride of the level that is counted
+// up is added.
+void
+ntxTimingModel::dagStep() {
+    const ntxTimingJob & j = jobs[curJob];
+    for(uint32_t l=0; l < j.outerLevel; l++) {
+        if(cnt[l] < j.loopBound[l]) {
+            cnt[l]++;
+            for(uint32_t o=0; o < C_N_AGUS; o++)
+                agu[o] += j.aguStride[o][l];
+            return;
+        }
+        cnt[l] = 0;
+    }
+}
+
+// writes a command to the FPU, and the read requests of its operands to
+// the request FIFOs. operand A is read with AGU aguA, operand B with AGU 1.
+void
+ntxTimingModel::issue(const fpuCmd & cmd, uint32_t aguA) {
+    fpu.cmdFifo.push(cmd);
+    if(cmd.readA)
+        fpu.reqFifo[0].push(agu[aguA]);
+    if(cmd.readB)
+        fpu.reqFifo[1].push(agu[1]);
+}
+
+void
+ntxTimingModel::request(uint64_t now, ntxTcdmReq req[C_NTX_N_TCDM_PORTS]) const {
+
+    const bool rd0 = fpu.reqFifo[0].n > 0;
+    const bool rd1 = fpu.reqFifo[1].n > 0;
+
+    // results in the output FIFO
+    uint32_t nOut = 0;
+    while(nOut < fpu.outFifo.n && fpu.outFifo.at(nOut).ready <= now)
+        nOut++;
+
+    // the write back uses a free port. if both ports read, it takes turns
+    // with the reads once the output FIFO fills up (see ntx.vhd).
+    const bool full = nOut > C_FPU_OUTPUT_ALM_EMPTY;
+    bool wb[C_NTX_N_TCDM_PORTS];
+    wb[0] = nOut > 0 && ((!rd0 && rd1) || (full && rd0 && rd1 && !fpu.toggle));
+    wb[1] = nOut > 0 && (!rd1 || (full && rd0 && rd1 && fpu.toggle));
+
+    for(uint32_t p=0; p < C_NTX_N_TCDM_PORTS; p++) {
+        req[p].valid = wb[p] || fpu.reqFifo[p].n > 0;
+        req[p].write = wb[p];
+        req[p].addr  = wb[p] ? fpu.outFifo.front().addr : (fpu.reqFifo[p].n ? fpu.reqFifo[p].front() : 0);
+    }
+}
+
+void
+ntxTimingModel::advance(uint64_t now, const bool grant[C_NTX_N_TCDM_PORTS]) {
+
+    ntxTcdmReq req[C_NTX_N_TCDM_PORTS];
+    request(now, req);
+
+    if(!(state == IDLE && drained()))
+        stats.activeCycles++;
+
+    // FPU: executes the command at the head of its FIFO once the operands
+    // are there and the output FIFO has space. ALU results wait until the
+    // MAC pipeline is empty, so that the write backs stay in order.
+    uint32_t executed = 0;
+    if(fpu.cmdFifo.n) {
+        const fpuCmd & cmd = fpu.cmdFifo.front();
+        const bool macBusy = fpu.outFifo.n && fpu.outFifo.back().ready > now;
+        if((!cmd.readA || fpu.opCnt[0]) && (!cmd.readB || fpu.opCnt[1]) &&
+           fpu.outFifo.n < C_FPU_OUTPUT_FIFO_DEPTH && !(cmd.aluOut && macBusy)) {
+            fpu.opCnt[0] -= cmd.readA;
+            fpu.opCnt[1] -= cmd.readB;
+            if(cmd.macOut || cmd.aluOut)
+                fpu.outFifo.push({now + (cmd.macOut ? C_FP32_MAC_LAT : 1), cmd.wbAddr});
+            fpu.cmdFifo.pop();
+            executed = 1;
+        }
+    }
+
+    // TCDM ports
+    for(uint32_t p=0; p < C_NTX_N_TCDM_PORTS; p++) {
+        if(!req[p].valid)
+            continue;
+        if(!grant[p]) {
+            stats.conflicts++;
+            continue;
+        }
+        if(req[p].write) {
+            fpu.outFifo.pop();
+            stats.writes++;
+            if(fpu.reqFifo[p].n)
+                fpu.toggle = !fpu.toggle;
+        } else {
+            fpu.reqFifo[p].pop();
+            fpu.rdFifo[p].push(now + C_FPU_TCDM_READ_LATENCY);
+            stats.reads++;
+        }
+    }
+
+    // read data enters the operand FIFOs, the FPU sees it in the next cycle
+    for(uint32_t p=0; p < C_NTX_N_TCDM_PORTS; p++) {
+        while(fpu.rdFifo[p].n && fpu.rdFifo[p].front() <= now) {
+            fpu.rdFifo[p].pop();
+            fpu.opCnt[p]++;
+        }
+    }
+
+    // controller, see p_fsm in ntx_ctrl.vhd. it stalls while all credits
+    // of the FPU command FIFO are taken.
+    const bool stall  = fpu.inFlight == C_FPU_INPUT_FIFO_DEPTH;
+    uint32_t   issued = 0;
+
+    if(state == IDLE) {
+        if(nextJob < jobs.size() && !jobs[nextJob].barrier) {
+            if(stall) {
+                stats.stallCycles++;
+            } else {
+                curJob = nextJob++;
+                const ntxTimingJob & j = jobs[curJob];
+                for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+                    cnt[l] = 0;
+                for(uint32_t o=0; o < C_N_AGUS; o++)
+                    agu[o] = j.aguOff[o];
+                state = CALC_STEP;
+                stats.cmds++;
+            }
+        }
+    } else if(stall) {
+        stats.stallCycles++;
+    } else {
+        const ntxTimingJob & j = jobs[curJob];
+        const bool load = j.initSel != C_NTX_INIT_WITH_ZERO;
+        const bool initCycle = j.opCode != C_NTX_VMULT_OP &&
+                               !(j.opCode == C_NTX_COPY_OP && (j.auxFunc & C_NTX_COPY_AUX_VECT));
+
+        if(state == CALC_STEP && initCycle && loopStartAt(j.initLevel)) {
+            // init step, without counting up
+            fpuCmd cmd = {load, false, false, false, 0};
+            uint32_t aguA = j.initSel;
+            if(j.opCode == C_NTX_MASKMAC_OP) {
+                cmd.readA = true;
+                cmd.readB = load;
+                aguA      = 0;
+            }
+            issue(cmd, load ? aguA : 0);
+            state = INIT_STEP;
+        } else {
+            // compute step, see FpuCmdStepLut_D
+            const bool cmpCnt = j.auxFunc & C_NTX_MASK_AUX_CMP_CNT;
+            const bool store  = loopEnd(j.innerLevel);
+            const bool mac    = ntxUsesMac(j.opCode);
+            fpuCmd cmd = {false, false, store && mac, store && !mac, agu[2]};
+            uint32_t aguA = 0;
+            switch(j.opCode) {
+                case C_NTX_MAC_OP:
+                case C_NTX_VMULT_OP:   cmd.readA = true; cmd.readB = true;    break;
+                case C_NTX_VADDSUB_OP:
+                case C_NTX_OUTERP_OP:  cmd.readA = true;                      break;
+                case C_NTX_MAXMIN_OP:
+                case C_NTX_THTST_OP:   cmd.readB = true;                      break;
+                case C_NTX_MASK_OP:    cmd.readA = true; cmd.readB = !cmpCnt; break;
+                case C_NTX_MASKMAC_OP: cmd.readA = true; cmd.readB = !cmpCnt; aguA = 2; break;
+                case C_NTX_COPY_OP:    cmd.readA = j.auxFunc & C_NTX_COPY_AUX_VECT; break;
+            }
+            issue(cmd, aguA);
+            stats.steps++;
+            stats.macs += mac;
+
+            if(loopEnd(j.outerLevel)) {
+                state = IDLE;
+            } else {
+                dagStep();
+                state = CALC_STEP;
+            }
+        }
+        issued = 1;
+    }
+
+    fpu.inFlight = fpu.inFlight + issued - executed;
+}
+
+ntxPerfEstimate
+ntxTimingModel::runIdeal(const ntxTimingJob & job) {
+
+    const bool grant[C_NTX_N_TCDM_PORTS] = {true, true};
+    const uint64_t cmds  = stats.cmds;
+    const uint64_t steps = stats.steps;
+
+    push(job);
+
+    // the controller takes the command once it is done with the last one
+    while(stats.cmds == cmds)
+        advance(idealTime++, grant);
+    const uint64_t start = idealTime - 1;
+
+    while(state != IDLE)
+        advance(idealTime++, grant);
+
+    // the last write back. the next command overlaps with it, so the FPU
+    // and the statistics go back to the state at the end of the command.
+    // the controller is idle and has no jobs left, so it does not change.
+    const fpuState       fpuEnd   = fpu;
+    const ntxTimingStats statsEnd = stats;
+    uint64_t             end      = idealTime;
+    while(!idle())
+        advance(end++, grant);
+    fpu   = fpuEnd;
+    stats = statsEnd;
+
+    ntxPerfEstimate est;
+    est.cycles      = end - start;
+    est.issueCycles = idealTime - start;
+    est.steps       = stats.steps - steps;
+    est.utilization = (double)est.steps / est.issueCycles;
+    est.endCycle    = end;
+    return est;
+}
+
+ntxTimingJob
+ntxTimingJobOf(const ntx_api & ntx, const void * base) {
+
+    ntxTimingJob job = {};
+    job.barrier    = false;
+    job.opCode     = ntx.opCode;
+    job.auxFunc    = ntx.auxFunc;
+    job.initSel    = ntx.initSel;
+    job.initLevel  = ntx.initLevel;
+    job.innerLevel = ntx.innerLevel;
+    job.outerLevel = ntx.outerLevel;
+    for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+        job.loopBound[l] = ntx.loopBound.w[l];
+    for(uint32_t o=0; o < C_N_AGUS; o++) {
+        job.aguOff[o] = (intptr_t)ntx.aguOff.w[o] - (intptr_t)base;
+        for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+            job.aguStride[o][l] = ntx.aguStride[o][l];
+    }
+    return job;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cluster
+///////////////////////////////////////////////////////////////////////////////
+
+ntxCluster::ntxCluster(uint32_t nNtx, uint32_t tcdmBytes, uint32_t nBanks_) :
+    mem(tcdmBytes / sizeof(uint32_t)),
+    members(nNtx),
+    bcast(C_NTX_BROADCAST_ADDR, members.data(), members.data() + nNtx),
+    models(nNtx),
+    nBanks(nBanks_),
+    rrNtx(nBanks_, 0),
+    rrCore(nBanks_, 0),
+    prioCnt(nBanks_, 0)
+{
+    assert(nNtx > 0 && nBanks > 0 && mem.size() > 0);
+
+    for(uint32_t k=0; k < nNtx; k++) {
+        members[k].setNstAddr(C_NTX_BASE_ADDR + k * C_NTX_OFFSET);
+        members[k].setTcdmBaseCheck(mem.data(), mem.data() + mem.size() - 1);
+        members[k].cluster = this;
+    }
+}
+
+void
+ntxCluster::setCoreTraffic(uint32_t nCores, double load) {
+    coreReq.assign(nCores, -1);
+    coreLoad = load;
+}
+
+void
+ntxCluster::barrier() {
+    ntxTimingJob job = {};
+    job.barrier = true;
+    for(auto & m : models)
+        m.push(job);
+}
+
+void
+ntxCluster::record(const ntx_api & ntx) {
+    const size_t k = &ntx - members.data();
+    assert(k < members.size());
+
+    // the members of a broadcast record their commands from different
+    // threads, but each into its own model
+    models[k].push(ntxTimingJobOf(ntx, mem.data()));
+}
+
+uint64_t
+ntxCluster::simulate() {
+
+    const uint32_t nPorts = members.size() * C_NTX_N_TCDM_PORTS;
+    const uint32_t nCores = coreReq.size();
+
+    std::vector<ntxTcdmReq> req(nPorts);
+    std::vector<uint8_t>    grant(nPorts);
+    std::vector<int32_t>    ntxWin(nBanks, -1);
+    std::vector<int32_t>    coreWin(nBanks, -1);
+    std::vector<uint32_t>   touched;
+
+    auto bankOf = [&](int64_t addr) {
+        const int64_t b = (addr >> 2) % (int64_t)nBanks;
+        return (uint32_t)(b < 0 ? b + nBanks : b);
+    };
+
+    // the requester that is next in round robin order after rr
+    auto rrBefore = [](uint32_t a, uint32_t b, uint32_t rr, uint32_t n) {
+        return (a + n - rr) % n < (b + n - rr) % n;
+    };
+
+    const uint64_t start = clusterStats.cycles;
+    uint64_t       now   = start;
+
+    for(;; now++) {
+
+        // barriers, and the end of the replay
+        bool allIdle = true, allAtBarrier = true;
+        for(auto & m : models) {
+            allIdle      &= m.idle();
+            allAtBarrier &= m.atBarrier();
+        }
+        if(allIdle)
+            break;
+        if(allAtBarrier)
+            for(auto & m : models)
+                m.popBarrier();
+
+        // new core requests
+        for(uint32_t c=0; c < nCores; c++) {
+            if(coreReq[c] >= 0)
+                continue;
+            lfsr ^= lfsr << 13;
+            lfsr ^= lfsr >> 7;
+            lfsr ^= lfsr << 17;
+            if((double)(lfsr >> 11) * (1.0 / 9007199254740992.0) < coreLoad) {
+                coreReq[c] = (lfsr >> 32) % nBanks;
+                clusterStats.coreReqs++;
+            }
+        }
+
+        // round robin among the NTX ports and among the cores of a bank
+        touched.clear();
+        for(uint32_t k=0; k < members.size(); k++)
+            models[k].request(now, &req[k * C_NTX_N_TCDM_PORTS]);
+
+        for(uint32_t i=0; i < nPorts; i++) {
+            grant[i] = 0;
+            if(!req[i].valid)
+                continue;
+            const uint32_t b = bankOf(req[i].addr);
+            if(ntxWin[b] < 0 && coreWin[b] < 0)
+                touched.push_back(b);
+            if(ntxWin[b] < 0 || rrBefore(i, ntxWin[b], rrNtx[b], nPorts))
+                ntxWin[b] = i;
+        }
+        for(uint32_t c=0; c < nCores; c++) {
+            if(coreReq[c] < 0)
+                continue;
+            const uint32_t b = coreReq[c];
+            if(ntxWin[b] < 0 && coreWin[b] < 0)
+                touched.push_back(b);
+            if(coreWin[b] < 0 || rrBefore(c, coreWin[b], rrCore[b], nCores))
+                coreWin[b] = c;
+        }
+
+        // NTX against cores, according to the priority of the NTX
+        for(uint32_t b : touched) {
+            const int32_t w = ntxWin[b];
+            const int32_t c = coreWin[b];
+            bool toNtx = w >= 0;
+
+            if(w >= 0 && c >= 0) {
+                switch(members[w / C_NTX_N_TCDM_PORTS].tcdmPrio) {
+                    case C_NTX_CTRL_PRIO_RR:
+                        toNtx      = prioCnt[b] == 0;
+                        prioCnt[b] = !prioCnt[b];
+                        break;
+                    case C_NTX_CTRL_PRIO_71:
+                        toNtx      = prioCnt[b] < 7;
+                        prioCnt[b] = (prioCnt[b] + 1) & 7;
+                        break;
+                    default:
+                        toNtx = true;
+                        break;
+                }
+            }
+
+            if(toNtx) {
+                grant[w] = 1;
+                rrNtx[b] = (w + 1) % nPorts;
+            } else {
+                coreReq[c] = -1;
+                rrCore[b]  = (c + 1) % nCores;
+            }
+            ntxWin[b]  = -1;
+            coreWin[b] = -1;
+        }
+
+        for(uint32_t c=0; c < nCores; c++)
+            if(coreReq[c] >= 0)
+                clusterStats.coreConflicts++;
+
+        for(uint32_t k=0; k < members.size(); k++) {
+            const bool g[C_NTX_N_TCDM_PORTS] = {grant[k * C_NTX_N_TCDM_PORTS] != 0,
+                                                grant[k * C_NTX_N_TCDM_PORTS + 1] != 0};
+            models[k].advance(now, g);
+        }
+    }
+
+    // pending core requests are dropped with the end of the replay
+    for(uint32_t c=0; c < nCores; c++)
+        coreReq[c] = -1;
+
+    clusterStats.cycles = now;
+    return now - start;
+}
+
+void
+ntxCluster::report(FILE * fid) const {
+
+    const double cycles = clusterStats.cycles ? (double)clusterStats.cycles : 1.0;
+    uint64_t     macs   = 0;
+
+    fprintf(fid, "NTX   cmds       steps        macs  MAC/cycle     reads    writes  conflicts  stalls  active\n");
+    for(uint32_t k=0; k < models.size(); k++) {
+        const ntxTimingStats & s = models[k].stats;
+        fprintf(fid, "%3u %6" PRIu64 " %11" PRIu64 " %11" PRIu64 " %10.3f %9" PRIu64 " %9" PRIu64
+                " %10" PRIu64 " %7" PRIu64 " %6.1f%%\n",
+                k, s.cmds, s.steps, s.macs, s.macs / cycles, s.reads, s.writes,
+                s.conflicts, s.stallCycles, 100.0 * s.activeCycles / cycles);
+        macs += s.macs;
+    }
+
+    fprintf(fid, "cluster: %u NTXs, %u banks, %" PRIu64 " cycles, %.3f MAC/cycle\n",
+            (uint32_t)models.size(), nBanks, clusterStats.cycles, macs / cycles);
+    if(!coreReq.empty())
+        fprintf(fid, "cores: %u, %" PRIu64 " requests, %" PRIu64 " conflicts\n",
+                (uint32_t)coreReq.size(), clusterStats.coreReqs, clusterStats.coreConflicts);
+}
@@ -0,0 +1,261 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "ntx_api.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// cycle model of a cluster of NTXs that share a banked TCDM. the commands
+// issued on the NTXs of the cluster are emulated as usual, and recorded.
+// simulate() then replays the recorded commands cycle by cycle: each NTX
+// generates the address streams of its two TCDM ports like the controller,
+// the FPU FIFOs and the write back logic in src/ntx*.vhd, and the requests
+// to the same bank are arbitrated according to the TCDM priority of the NTXs
+// (see setTcdmPrio). optionally, the cores of the cluster add random traffic.
+//
+// the model is cycle-approximate: the conditional write backs of MASKMAC are
+// assumed to take place, and the TCDM grants requests in the same cycle.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef NTX_EMULATION_ON
+
+// pipeline parameters, must be aligned with src/ntx_pkg.vhd and src/fp32_pkg.vhd
+#define C_FP32_PCS_N_SEGS          2
+#define C_FP32_MAC_LAT             (2*C_FP32_PCS_N_SEGS+6)
+#define C_FPU_TCDM_READ_LATENCY    1
+#define C_FPU_INPUT_FIFO_DEPTH     5
+#define C_FPU_OUTPUT_FIFO_DEPTH    7
+#define C_FPU_OUTPUT_ALM_EMPTY     (C_FPU_OUTPUT_FIFO_DEPTH/2) // write back has priority over reads above this fill level
+#define C_NTX_N_TCDM_PORTS         2
+
+// default number of word interleaved TCDM banks
+#define C_NTX_CLUSTER_N_BANKS      32
+
+// smallest power of two that is not below n
+static constexpr uint32_t
+ntxPow2Ceil(uint32_t n, uint32_t p = 1) {
+    return p >= n ? p : ntxPow2Ceil(n, 2 * p);
+}
+
+// a recorded command, or a barrier (see ntxCluster::barrier)
+struct ntxTimingJob {
+    bool     barrier;
+    uint8_t  opCode;
+    uint8_t  auxFunc;
+    uint8_t  initSel;
+    uint8_t  initLevel;
+    uint8_t  innerLevel;
+    uint8_t  outerLevel;
+    uint32_t loopBound[C_N_HW_LOOPS];          // inclusive, as staged
+    int64_t  aguOff[C_N_AGUS];                 // byte addresses
+    int32_t  aguStride[C_N_AGUS][C_N_HW_LOOPS]; // byte increments, as staged
+};
+
+// statistics of one NTX
+struct ntxTimingStats {
+    uint64_t cmds         = 0;
+    uint64_t activeCycles = 0; // cycles with a command in the controller or in the FPU
+    uint64_t steps        = 0; // loop iterations
+    uint64_t macs         = 0; // iterations that use the multiply-accumulate unit
+    uint64_t reads        = 0;
+    uint64_t writes       = 0;
+    uint64_t conflicts    = 0; // port requests that lost the bank arbitration
+    uint64_t stallCycles  = 0; // cycles the controller waited for the FPU
+};
+
+// one TCDM port request
+struct ntxTcdmReq {
+    bool    valid;
+    bool    write;
+    int64_t addr;
+};
+
+// cycle model of one NTX. each cycle, the owner calls request() to get the
+// requests of the TCDM ports, and then advance() with the grants.
+class ntxTimingModel {
+    public:
+
+    // appends a command or a barrier to the job FIFO of the model
+    void push(const ntxTimingJob & job);
+
+    // true if all jobs are done and the pipeline is empty
+    bool idle() const;
+
+    // true if the next job is a barrier, and all jobs before it are done
+    bool atBarrier() const;
+
+    // removes the barrier at the head of the job FIFO
+    void popBarrier();
+
+    void request(uint64_t now, ntxTcdmReq req[C_NTX_N_TCDM_PORTS]) const;
+    void advance(uint64_t now, const bool grant[C_NTX_N_TCDM_PORTS]);
+
+    // runs a command right after the previous one, on a TCDM that grants
+    // all requests. only for models that are not part of a cluster.
+    ntxPerfEstimate runIdeal(const ntxTimingJob & job);
+
+    ntxTimingStats stats;
+
+    private:
+
+    // commands of the FPU, see FpuCmdInitLut_D and FpuCmdStepLut_D
+    struct fpuCmd {
+        bool    readA;
+        bool    readB;
+        bool    macOut;  // result through the MAC pipeline
+        bool    aluOut;  // result straight from the ALU
+        int64_t wbAddr;
+    };
+
+    // small FIFO of DEPTH entries. the capacity N is a power of two, so that
+    // the indices wrap with a mask.
+    template <class T, uint32_t DEPTH, uint32_t N = ntxPow2Ceil(DEPTH)> struct ring {
+        static_assert((N & (N - 1)) == 0 && N >= DEPTH, "ring capacity must be a power of two of at least DEPTH");
+        T        buf[N];
+        uint32_t head = 0;
+        uint32_t n    = 0;
+        const T & at(uint32_t k) const { return buf[(head + k) & (N - 1)]; }
+        const T & front() const { return at(0); }
+        const T & back() const { return at(n - 1); }
+        void push(const T & v) { assert(n < DEPTH); buf[(head + n++) & (N - 1)] = v; }
+        void pop() { head = (head + 1) & (N - 1); n--; }
+    };
+
+    // a result on its way to the TCDM
+    struct fpuOut {
+        uint64_t ready;
+        int64_t  addr;
+    };
+
+    enum ctrlState { IDLE, CALC_STEP, INIT_STEP };
+
+    bool drained() const;
+    void issue(const fpuCmd & cmd, uint32_t aguA);
+    bool loopStartAt(uint32_t level) const;
+    bool loopEnd(uint32_t level) const;
+    void dagStep();
+
+    std::vector<ntxTimingJob> jobs;
+    size_t                    nextJob = 0;
+    size_t                    curJob  = 0; // in the controller, unless IDLE
+
+    // FIFOs and pipeline between the controller and the TCDM
+    struct fpuState {
+        uint32_t       inFlight = 0; // credits of the FPU command FIFO
+        bool           toggle   = false;
+        uint32_t       opCnt[C_NTX_N_TCDM_PORTS] = {0, 0};
+        // the command FIFO and the reads of its commands are bounded by the
+        // credits, the results by the output FIFO
+        ring<fpuCmd,   C_FPU_INPUT_FIFO_DEPTH>  cmdFifo;
+        ring<int64_t,  C_FPU_INPUT_FIFO_DEPTH>  reqFifo[C_NTX_N_TCDM_PORTS];
+        ring<uint64_t, C_FPU_INPUT_FIFO_DEPTH>  rdFifo[C_NTX_N_TCDM_PORTS]; // arrival cycles of read data
+        ring<fpuOut,   C_FPU_OUTPUT_FIFO_DEPTH> outFifo;                   // MAC pipeline and output FIFO
+    };
+
+    ctrlState      state = IDLE;
+    uint32_t       cnt[C_N_HW_LOOPS];
+    int64_t        agu[C_N_AGUS];
+    fpuState       fpu;
+
+    uint64_t       idealTime = 0;             // cycle counter of runIdeal
+};
+
+// the staged command of ntx, with the AGU offsets relative to base
+ntxTimingJob ntxTimingJobOf(const ntx_api & ntx, const void * base);
+
+// statistics of a cluster
+struct ntxClusterStats {
+    uint64_t cycles         = 0;
+    uint64_t coreReqs       = 0;
+    uint64_t coreConflicts  = 0;
+};
+
+class ntxCluster {
+    public:
+
+    // a cluster of nNtx NTXs with a TCDM of tcdmBytes bytes, interleaved
+    // word by word over nBanks banks
+    ntxCluster(uint32_t nNtx, uint32_t tcdmBytes, uint32_t nBanks = C_NTX_CLUSTER_N_BANKS);
+
+    ntxCluster(const ntxCluster &) = delete;
+    ntxCluster & operator=(const ntxCluster &) = delete;
+
+    uint32_t size() const {
+        return members.size();
+    }
+
+    // NTX k of the cluster
+    ntx_api & operator[](uint32_t k) {
+        return members[k];
+    }
+
+    // broadcast alias of all NTXs of the cluster
+    ntx_api & broadcast() {
+        return bcast;
+    }
+
+    // base of the TCDM. the AGUs of the NTXs are checked against it.
+    uint32_t * tcdm() {
+        return mem.data();
+    }
+
+    // adds nCores cores that issue a request to a random bank with
+    // probability load in each cycle, and retry until it is granted
+    void setCoreTraffic(uint32_t nCores, double load);
+
+    // the commands issued after the barrier start when all NTXs have
+    // finished the commands issued before it, like after an idleWait on the
+    // broadcast alias
+    void barrier();
+
+    // called by ntx_api::issueCmd
+    void record(const ntx_api & ntx);
+
+    // replays the commands recorded since the last call, and returns the
+    // number of cycles. the statistics are accumulated over all calls.
+    uint64_t simulate();
+
+    const ntxTimingStats & ntxStats(uint32_t k) const {
+        return models[k].stats;
+    }
+
+    const ntxClusterStats & stats() const {
+        return clusterStats;
+    }
+
+    // prints the statistics of all NTXs and of the cluster
+    void report(FILE * fid = stdout) const;
+
+    private:
+
+    std::vector<uint32_t>       mem;
+    std::vector<ntx_api>        members;
+    ntx_api                     bcast;
+    std::vector<ntxTimingModel> models;
+    ntxClusterStats             clusterStats;
+
+    // TCDM arbitration state per bank
+    uint32_t                    nBanks;
+    std::vector<uint32_t>       rrNtx;   // next NTX port with priority
+    std::vector<uint32_t>       rrCore;  // next core with priority
+    std::vector<uint8_t>        prioCnt; // C_NTX_CTRL_PRIO_RR and C_NTX_CTRL_PRIO_71
+
+    // cores
+    double                      coreLoad = 0.0;
+    std::vector<int64_t>        coreReq; // pending bank, or -1
+    uint64_t                    lfsr     = 0x2545F4914F6CDD1DULL;
+};
+
+#endif
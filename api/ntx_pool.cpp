@@ -0,0 +1,122 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "ntx_pool.hpp"
+
+// set in the worker threads, and while the caller of run() takes part
+static thread_local bool ntxInPool = false;
+
+ntxThreadPool &
+ntxThreadPool::instance ()
+{
+    static ntxThreadPool pool;
+    return pool;
+}
+
+ntxThreadPool::ntxThreadPool () :
+    next(0)
+{
+    const char * env = getenv("NTX_THREADS");
+    int32_t n = env ? atoi(env) : (int32_t)std::thread::hardware_concurrency();
+    nThreads = (uint32_t)std::max(1, std::min(n, C_NTX_POOL_MAX_THREADS));
+
+    for(uint32_t t = 1; t<nThreads; t++)
+        workers.push_back(std::thread(&ntxThreadPool::worker, this));
+}
+
+ntxThreadPool::~ntxThreadPool ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    start.notify_all();
+
+    for(auto & w : workers)
+        w.join();
+}
+
+// claims and runs jobs of the current run() until there are none left
+void
+ntxThreadPool::work ()
+{
+    for(;;) {
+        const uint32_t k = next.fetch_add(1);
+        if(k >= jobN)
+            return;
+        jobFn(jobCtx, k);
+    }
+}
+
+void
+ntxThreadPool::worker ()
+{
+    ntxInPool = true;
+    uint64_t seen = 0;
+
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&]() { return stop || generation != seen; });
+            if(stop)
+                return;
+            seen = generation;
+            active++;
+        }
+
+        work();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active--;
+        }
+        finish.notify_one();
+    }
+}
+
+void
+ntxThreadPool::run (uint32_t n, void (*fn)(void *, uint32_t), void * ctx)
+{
+    // nested or concurrent use runs serially
+    if(n <= 1 || nThreads == 1 || ntxInPool || !busy.try_lock()) {
+        for(uint32_t k = 0; k<n; k++)
+            fn(ctx, k);
+        return;
+    }
+
+    {
+        // a worker may still be on its way out of the last job
+        std::unique_lock<std::mutex> lock(mutex);
+        finish.wait(lock, [&]() { return active == 0; });
+        jobFn  = fn;
+        jobCtx = ctx;
+        jobN   = n;
+        next   = 0;
+        generation++;
+    }
+    start.notify_all();
+
+    ntxInPool = true;
+    work();
+    ntxInPool = false;
+
+    // wait until the workers have finished their jobs
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finish.wait(lock, [&]() { return active == 0; });
+    }
+
+    busy.unlock();
+}
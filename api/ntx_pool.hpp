@@ -0,0 +1,83 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// persistent pool of worker threads for the emulation. the workers are
+// started on first use, their number (including the calling thread) is taken
+// from the environment variable NTX_THREADS (default: all hardware threads).
+///////////////////////////////////////////////////////////////////////////////
+
+#define C_NTX_POOL_MAX_THREADS 64
+
+class ntxThreadPool {
+    public:
+
+    // the pool shared by all NTXs
+    static ntxThreadPool & instance();
+
+    // number of threads that take part in run(), including the caller
+    uint32_t size() const {
+        return nThreads;
+    }
+
+    // runs fn(ctx, k) for k = 0..n-1 and returns when all calls are done.
+    // the calling thread takes part. calls from within a job, and calls
+    // while another thread uses the pool, run serially on the calling
+    // thread. does not allocate memory.
+    void run(uint32_t n, void (*fn)(void *, uint32_t), void * ctx);
+
+    // same for a callable f(k)
+    template <class F>
+    void run(uint32_t n, F & f) {
+        run(n, [](void * ctx, uint32_t k) { (*(F *)ctx)(k); }, &f);
+    }
+
+    ~ntxThreadPool();
+
+    private:
+
+    ntxThreadPool();
+    void worker();
+    void work();
+
+    uint32_t                 nThreads;
+    std::vector<std::thread> workers;
+
+    // the job, guarded by mutex. jobs are claimed with next.
+    std::mutex               mutex;
+    std::mutex               busy;
+    std::condition_variable  start;
+    std::condition_variable  finish;
+    uint64_t                 generation = 0;
+    uint32_t                 active     = 0;
+    bool                     stop       = false;
+    void                  (* jobFn)(void *, uint32_t) = nullptr;
+    void *                   jobCtx     = nullptr;
+    uint32_t                 jobN       = 0;
+    std::atomic<uint32_t>    next;
+};
+
+// runs fn(ctx, k) for k = 0..n-1 on the shared pool, as the job runner of
+// pcsMacDotParallel (see fp32_jobRunType)
+static inline void
+ntxPoolRun(uint32_t n, void (*fn)(void *, uint32_t), void * ctx) {
+    ntxThreadPool::instance().run(n, fn, ctx);
+}
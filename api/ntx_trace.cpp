@@ -0,0 +1,174 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "ntx_trace.hpp"
+
+#ifdef NTX_TRACE_ON
+
+///////////////////////////////////////////////////////////////////////////////
+// trace file, shared by all threads. it is only touched when a ring drains.
+///////////////////////////////////////////////////////////////////////////////
+
+static std::mutex            ntxTraceFileMutex;
+static FILE *                ntxTraceFile    = nullptr;
+static bool                  ntxTraceFileErr = false;
+static std::atomic<uint32_t> ntxTraceNextTid(0);
+
+static void ntxTraceWrite (const ntxTraceRec * recs,
+                           const size_t        n)
+{
+    std::lock_guard<std::mutex> lock(ntxTraceFileMutex);
+
+    // open the file and write the header on first use
+    if(!ntxTraceFile && !ntxTraceFileErr) {
+        const char * name = getenv("NTX_TRACE_FILE");
+        ntxTraceFile = fopen(name ? name : "ntx_trace.bin", "wb");
+        if(!ntxTraceFile) {
+            fprintf(stderr, "ntxTrace: cannot open trace file %s\n", name ? name : "ntx_trace.bin");
+            ntxTraceFileErr = true;
+            return;
+        }
+        const ntxTraceFileHeader hdr = {C_NTX_TRACE_MAGIC, C_NTX_TRACE_VERSION, sizeof(ntxTraceRec)};
+        fwrite(&hdr, sizeof(hdr), 1, ntxTraceFile);
+    }
+
+    if(ntxTraceFile) {
+        fwrite(recs, sizeof(ntxTraceRec), n, ntxTraceFile);
+        fflush(ntxTraceFile);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// per thread ring. only the owning thread writes to it, so emitting a record
+// needs neither locks nor atomics.
+///////////////////////////////////////////////////////////////////////////////
+
+class ntxTraceRing {
+    public:
+    std::vector<ntxTraceRec> buf;
+    uint32_t head = 0;
+    uint32_t tid;
+
+    ntxTraceRing() :
+        buf(C_NTX_TRACE_RING_LEN),
+        tid(ntxTraceNextTid++) {
+    }
+
+    ~ntxTraceRing() {
+        drain();
+    }
+
+    void drain() {
+        if(head)
+            ntxTraceWrite(buf.data(), head);
+        head = 0;
+    }
+
+    ntxTraceRec & alloc(const uint16_t point,
+                        const uint8_t  opCode,
+                        const uint8_t  flags) {
+        if(head == C_NTX_TRACE_RING_LEN)
+            drain();
+
+        ntxTraceRec & rec = buf[head++];
+        memset(&rec, 0, sizeof(rec));
+        rec.point  = point;
+        rec.opCode = opCode;
+        rec.flags  = flags;
+        rec.tid    = tid;
+        return rec;
+    }
+};
+
+static thread_local ntxTraceRing ntxTraceLocalRing;
+
+///////////////////////////////////////////////////////////////////////////////
+// trace points
+///////////////////////////////////////////////////////////////////////////////
+
+void ntxTracePcs (const uint16_t          point,
+                  const uint8_t           flags,
+                  const uint32_t          arg0,
+                  const uint32_t          arg1,
+                  const fp32_accuType   * accu)
+{
+    ntxTraceRec & rec = ntxTraceLocalRing.alloc(point, C_NTX_TRACE_NO_OP, flags);
+    rec.arg[0] = arg0;
+    rec.arg[1] = arg1;
+    if(accu) {
+        for(uint32_t k = 0; k < C_FP32_N_ACCU_WORDS; k++)
+            rec.w[k] = accu->word(k);
+    }
+}
+
+void ntxTracePcs (const uint16_t          point,
+                  const uint8_t           flags,
+                  const uint32_t          arg0,
+                  const uint32_t          arg1,
+                  const fp32_csAccuType * accu)
+{
+    if(accu) {
+        fp32_accuType tmp;
+        csToPcs(*accu, tmp);
+        ntxTracePcs(point, flags, arg0, arg1, &tmp);
+    } else {
+        ntxTracePcs(point, flags, arg0, arg1, (const fp32_accuType *)nullptr);
+    }
+}
+
+void ntxTraceWords (const uint16_t        point,
+                    const uint8_t         flags,
+                    const uint32_t        arg0,
+                    const uint32_t        arg1,
+                    const uint64_t        w0,
+                    const uint64_t        w1,
+                    const uint64_t        w2)
+{
+    ntxTraceRec & rec = ntxTraceLocalRing.alloc(point, C_NTX_TRACE_NO_OP, flags);
+    rec.arg[0] = arg0;
+    rec.arg[1] = arg1;
+    rec.w[0]   = w0;
+    rec.w[1]   = w1;
+    rec.w[2]   = w2;
+}
+
+void ntxTraceOp (const uint16_t           point,
+                 const uint8_t            opCode,
+                 const uint8_t            flags,
+                 const uint32_t           cfg,
+                 void * const           * agu,
+                 const uint32_t           arg0,
+                 const uint32_t           arg1,
+                 const uint32_t           arg2)
+{
+    ntxTraceRec & rec = ntxTraceLocalRing.alloc(point, opCode, flags);
+    rec.cfg    = cfg;
+    rec.arg[0] = arg0;
+    rec.arg[1] = arg1;
+    rec.arg[2] = arg2;
+    for(uint32_t k = 0; k < C_NTX_TRACE_N_PTRS; k++)
+        rec.ptr[k] = (uint64_t)(size_t)agu[k];
+}
+
+void ntxTraceFlush ()
+{
+    ntxTraceLocalRing.drain();
+}
+
+#endif
@@ -0,0 +1,134 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "fp32_mac.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// structured trace points for the MAC model and the NTX emulation. compile
+// with -DNTX_TRACE_ON to enable them, otherwise the NTX_TRACE_* macros
+// expand to nothing.
+//
+// when enabled, each trace point writes a fixed size binary record into a
+// per thread ring buffer. the ring is drained to the trace file when it is
+// full, on ntxTraceFlush() and when the thread exits. the file name is taken
+// from the environment variable NTX_TRACE_FILE (default: ntx_trace.bin), and
+// test/traceDecode prints the records in human readable form.
+///////////////////////////////////////////////////////////////////////////////
+
+// trace file header
+#define C_NTX_TRACE_MAGIC          0x454341525458544EULL // "NTXTRACE"
+#define C_NTX_TRACE_VERSION        1
+
+// number of records per thread local ring
+#define C_NTX_TRACE_RING_LEN       4096
+#define C_NTX_TRACE_N_PTRS         3
+
+// trace points of the MAC model
+#define C_NTX_TRACE_PCS_MAC_CALL   0x00 // arg: opA, opB; flags: accuSel, subEn<<1, normEn<<2; w: accu
+#define C_NTX_TRACE_PCS_MAC_MULT   0x01 // arg: sign, exp; w[0]: mant
+#define C_NTX_TRACE_PCS_MAC_EXT    0x02 // w: converted multiplier output
+#define C_NTX_TRACE_PCS_MAC_ACCU   0x03 // w: accu after accumulation
+#define C_NTX_TRACE_PCS_MAC_NORM   0x04 // arg: res
+#define C_NTX_TRACE_PCS_TO_FP32    0x05 // arg: exp, res; w: accu magnitude
+#define C_NTX_TRACE_PCS_ADD_WORD   0x06 // flags: carryIn, carryOut<<1; w: out, opA, opB
+
+// trace points of the NTX emulation
+#define C_NTX_TRACE_LEVEL          0x10 // flags: level; arg: outerLevel
+#define C_NTX_TRACE_AGU_UPD        0x11 // flags: level; arg: isLast
+#define C_NTX_TRACE_INIT_ZERO      0x12
+#define C_NTX_TRACE_INIT_ACCU      0x13 // arg: init value
+#define C_NTX_TRACE_INIT_ALU       0x14 // arg: aluState, init value (MASKMAC)
+#define C_NTX_TRACE_NO_INIT        0x15
+#define C_NTX_TRACE_FETCH          0x16 // arg: opA, opB, aluState; flags: which of these are valid
+#define C_NTX_TRACE_STORE          0x17 // arg: res
+#define C_NTX_TRACE_NO_STORE       0x18
+
+// flags of C_NTX_TRACE_FETCH
+#define C_NTX_TRACE_FETCH_A        0x1
+#define C_NTX_TRACE_FETCH_B        0x2
+#define C_NTX_TRACE_FETCH_ALU      0x4
+
+// opCode of records that are not emitted by an NTX command
+#define C_NTX_TRACE_NO_OP          0xFF
+
+struct ntxTraceFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recSize;
+};
+
+struct ntxTraceRec {
+    uint16_t point;                        // trace point, see above
+    uint8_t  opCode;                       // NTX opcode or C_NTX_TRACE_NO_OP
+    uint8_t  flags;                        // trace point specific
+    uint32_t tid;                          // emitting thread (in order of first use)
+    uint32_t arg[3];                       // trace point specific
+    uint32_t cfg;                          // initSel | polarity<<8 | auxFunc<<16
+    uint64_t ptr[C_NTX_TRACE_N_PTRS];      // AGU addresses
+    uint64_t w[C_FP32_N_ACCU_WORDS];       // accumulator words
+};
+
+static_assert(sizeof(ntxTraceRec) == 88, "trace records must have a fixed layout");
+
+#ifdef NTX_TRACE_ON
+
+// MAC model trace points, with an optional accumulator
+void ntxTracePcs (const uint16_t          point,
+                  const uint8_t           flags,
+                  const uint32_t          arg0,
+                  const uint32_t          arg1,
+                  const fp32_accuType   * accu);
+
+void ntxTracePcs (const uint16_t          point,
+                  const uint8_t           flags,
+                  const uint32_t          arg0,
+                  const uint32_t          arg1,
+                  const fp32_csAccuType * accu);
+
+// MAC model trace points with raw 64bit words
+void ntxTraceWords (const uint16_t        point,
+                    const uint8_t         flags,
+                    const uint32_t        arg0,
+                    const uint32_t        arg1,
+                    const uint64_t        w0,
+                    const uint64_t        w1,
+                    const uint64_t        w2);
+
+// NTX emulation trace points
+void ntxTraceOp (const uint16_t           point,
+                 const uint8_t            opCode,
+                 const uint8_t            flags,
+                 const uint32_t           cfg,
+                 void * const           * agu,
+                 const uint32_t           arg0,
+                 const uint32_t           arg1,
+                 const uint32_t           arg2);
+
+// drains the ring of the calling thread to the trace file
+void ntxTraceFlush ();
+
+#define NTX_TRACE_PCS(...)   ntxTracePcs(__VA_ARGS__)
+#define NTX_TRACE_WORDS(...) ntxTraceWords(__VA_ARGS__)
+#define NTX_TRACE_OP(...)    ntxTraceOp(__VA_ARGS__)
+
+#else
+
+inline void ntxTraceFlush () {}
+
+#define NTX_TRACE_PCS(...)   do { } while(0)
+#define NTX_TRACE_WORDS(...) do { } while(0)
+#define NTX_TRACE_OP(...)    do { } while(0)
+
+#endif
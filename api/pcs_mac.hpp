@@ -0,0 +1,256 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "fp32_mac.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// MAC model templated on the input format and on the accumulator width, for
+// design space exploration. this is a straightforward (unwindowed) version of
+// the fp32 model in fp32_mac.cpp, and is bit-true to pcsMac when instantiated
+// with fmtFp32 and the default accumulator width (see test/pcsFormats.cpp).
+//
+// note that the exact accumulator width is 1 + 2^exponent bits + mantissa
+// bits + overflow bits. bf16 keeps the 8bit exponent of fp32, so its exact
+// accumulator still needs 268bit (five words), while fp16 fits into a single
+// word. narrower accumulators can be modelled with the WIDTH parameter, the
+// bits above WIDTH are cut away like the overflow bits in HW.
+///////////////////////////////////////////////////////////////////////////////
+
+// input format. as in the fp32 model, there are no NaNs, the maximum exponent
+// is a regular exponent, and denormals are treated like normal numbers.
+template <uint32_t EXP_WIDTH, uint32_t MANT_WIDTH>
+struct fpFormat {
+    static constexpr uint32_t expWidth  = EXP_WIDTH;
+    static constexpr uint32_t mantWidth = MANT_WIDTH;
+    static constexpr uint32_t width     = 1 + EXP_WIDTH + MANT_WIDTH;
+    static constexpr int32_t  bias      = (1 << (EXP_WIDTH-1)) - 1;
+    static constexpr int32_t  maxExp    = (1 << EXP_WIDTH) - 1;
+    static constexpr uint32_t signMask  = 1U << (width-1);
+    static constexpr uint32_t mantMask  = (1U << MANT_WIDTH) - 1;
+    static constexpr uint32_t infVal    = (uint32_t)maxExp << MANT_WIDTH;
+
+    static_assert(2*(MANT_WIDTH+1) < 64, "the mantissa product must fit into 64bit");
+
+    static bool isZero(const uint32_t in) {
+        return ((in & (signMask-1)) == 0);
+    }
+
+    static bool getSign(const uint32_t in) {
+        return (in & signMask) != 0;
+    }
+
+    static int32_t getExp(const uint32_t in) {
+        return (int32_t)((in >> MANT_WIDTH) & (uint32_t)maxExp);
+    }
+
+    static uint32_t getMantFull(const uint32_t in) {
+        return (in & mantMask) | (1U << MANT_WIDTH);
+    }
+};
+
+typedef fpFormat<8, 23> fmtFp32;
+typedef fpFormat<8, 7>  fmtBf16;
+typedef fpFormat<5, 10> fmtFp16;
+
+// accumulator for format F with WIDTH bits, stored in 64bit words
+template <class F, uint32_t WIDTH = 1 + (1 << F::expWidth) + F::mantWidth + C_FP32_N_ACCU_OFLOW_BITS>
+class pcsAccuT : public arr1D<uint64_t, (WIDTH + 63) / 64>
+{
+    public:
+    typedef F format;
+    static constexpr uint32_t width  = WIDTH;
+    static constexpr uint32_t nWords = (WIDTH + 63) / 64;
+};
+
+typedef pcsAccuT<fmtFp32> pcsAccuFp32;
+typedef pcsAccuT<fmtBf16> pcsAccuBf16;
+typedef pcsAccuT<fmtFp16> pcsAccuFp16;
+
+static_assert(pcsAccuFp32::width  == C_FP32_PCS_WIDTH,    "fp32 accumulator width mismatch");
+static_assert(pcsAccuFp32::nWords == C_FP32_N_ACCU_WORDS, "fp32 accumulator word count mismatch");
+
+///////////////////////////////////////////////////////////////////////////////
+// accumulator arithmetic
+///////////////////////////////////////////////////////////////////////////////
+
+// cut away the bits above the accumulator width and sign extend
+template <class A>
+inline void pcsMaskOflowFmt (A & acc)
+{
+    const uint32_t shift = 64*A::nWords - A::width;
+    acc.w[A::nWords-1] = (uint64_t)(((int64_t)(acc.w[A::nWords-1] << shift)) >> shift);
+}
+
+template <class A>
+inline void pcsInvFmt (const A & in,
+                             A & out)
+{
+    uint64_t carry = 1ULL;
+    for(uint32_t k = 0; k<A::nWords; k++) {
+        out.w[k] = ~in.w[k] + carry;
+        carry &= (out.w[k] == 0ULL);
+    }
+    pcsMaskOflowFmt(out);
+}
+
+template <class A>
+inline void pcsAddFmt (const A & opA,
+                       const A & opB,
+                             A & out)
+{
+    uint64_t carry = 0ULL;
+    for(uint32_t k = 0; k<A::nWords; k++) {
+        const uint64_t tmp = opA.w[k] + opB.w[k];
+        const uint64_t sum = tmp + carry;
+        carry    = (tmp < opA.w[k]) | (sum < tmp);
+        out.w[k] = sum;
+    }
+    pcsMaskOflowFmt(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// conversion of the extended multiplier output (2.2M bit mantissa) to the
+// accumulator format, see extFp32ToPcs
+///////////////////////////////////////////////////////////////////////////////
+template <class A>
+inline void extToPcsFmt (const bool     sign,
+                         const int32_t  exponent,
+                         const uint64_t mantissa,
+                               A      & output)
+{
+    typedef typename A::format F;
+
+    int32_t  tmpExp  = exponent;
+    uint64_t tmpMant = mantissa;
+
+    output.clear();
+
+    if(tmpExp < 0) {
+        return;
+    } else if(tmpExp >= F::maxExp) {
+        // models the same behavior as HW
+        tmpExp  = F::maxExp;
+        tmpMant = (1ULL << (F::mantWidth*2));
+    }
+
+    int32_t shiftSize = tmpExp - (int32_t)F::mantWidth;
+
+    if(shiftSize<0) {
+        output.w[0] = tmpMant >> -shiftSize;
+    } else {
+        const uint32_t off = shiftSize >> 6;
+        shiftSize &= 0x3F;
+
+        // narrow accumulators may not have room for all words
+        if(off < A::nWords)
+            output.w[off] = tmpMant << shiftSize;
+        if(off+1 < A::nWords && shiftSize)
+            output.w[off+1] = tmpMant >> (64-shiftSize);
+    }
+
+    pcsMaskOflowFmt(output);
+
+    // invert sign if needed
+    if(sign)
+        pcsInvFmt(output, output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// backwards conversion to the input format, see pcsToFp32
+///////////////////////////////////////////////////////////////////////////////
+template <class A>
+inline uint32_t pcsToFmt (const A & input)
+{
+    typedef typename A::format F;
+
+    A        tmpIn  = input;
+    uint32_t output = 0;
+
+    // check sign bit and invert if necessary
+    if(input.w[A::nWords-1] >> 63) {
+        output = F::signMask;
+        pcsInvFmt(input, tmpIn);
+    }
+
+    // position of the leading one
+    int32_t msb = -1;
+    for(int32_t off = A::nWords-1; off >= 0; off--) {
+        if(tmpIn.w[off]) {
+            msb = off*64 + 63 - __builtin_clzll(tmpIn.w[off]);
+            break;
+        }
+    }
+
+    const int32_t tmpExp = (msb < 0) ? -1 : msb - (int32_t)F::mantWidth;
+
+    if(tmpExp < 0) {
+        return output;
+    } else if(tmpExp >= F::maxExp) {
+        return output | F::infVal;
+    }
+
+    // cut the MSB away and pack
+    const int32_t  pos   = msb - (int32_t)F::mantWidth;
+    const uint32_t off   = pos >> 6;
+    const uint32_t shift = pos & 0x3F;
+    uint64_t mant = tmpIn.w[off] >> shift;
+    if(shift && off+1 < A::nWords)
+        mant |= tmpIn.w[off+1] << (64-shift);
+
+    return output | ((uint32_t)tmpExp << F::mantWidth) | ((uint32_t)mant & F::mantMask);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MAC model, same interface as pcsMac. the operands and the result are
+// encoded in the lower bits of the uint32_t arguments.
+///////////////////////////////////////////////////////////////////////////////
+template <class A>
+inline uint32_t pcsMacFmt (const uint32_t   opA,
+                           const uint32_t   opB,
+                           const uint8_t    accuSel,
+                           const uint8_t    subEn,
+                           const uint8_t    normEn,
+                                 A        & accuState,
+                                 uint32_t & res)
+{
+    typedef typename A::format F;
+
+    // multiplication
+    int32_t  expTmp  = F::getExp(opA) + F::getExp(opB) - F::bias;
+    uint64_t mantTmp = ((uint64_t) F::getMantFull(opA)) *
+                       ((uint64_t) F::getMantFull(opB));
+    bool     signTmp = F::getSign(opA) ^ F::getSign(opB);
+
+    if(F::isZero(opA) || F::isZero(opB)) {
+        mantTmp = 0ULL;
+        expTmp  = 0;
+    }
+
+    // convert this to fixed point representation
+    A tmp1;
+    extToPcsFmt(signTmp ^ (bool)subEn, expTmp, mantTmp, tmp1);
+
+    // use operand C if this is set
+    if(accuSel)
+        accuState = tmp1;
+    else
+        pcsAddFmt(tmp1, accuState, accuState);
+
+    // normalize the format only if needed
+    if(normEn)
+        res = pcsToFmt(accuState);
+
+    return 0;
+}
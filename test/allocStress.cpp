@@ -0,0 +1,146 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks that issueCmd does not allocate memory (see ntx_api::issueCmd).
+// issues millions of random commands over all opcodes, in synchronous mode,
+// with the timing estimate, and in asynchronous mode. malloc is wrapped at
+// link time (-Wl,--wrap=malloc, see the Makefile) and operator new is
+// replaced, so that every allocation is counted. after a warm up, which
+// starts the thread pool and the worker thread, neither the number of
+// allocations nor the resident set size may grow.
+//
+// usage: allocStress [commands]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_api.hpp"
+#include "rnd.hpp"
+
+#define C_TCDM_MEMSIZE (1<<14)
+#define C_N_WARMUP     1000
+#define C_RSS_SLACK_KB 256
+
+static std::atomic<uint64_t> nAllocs(0);
+
+extern "C" void * __real_malloc(size_t size);
+
+extern "C" void *
+__wrap_malloc(size_t size) {
+    nAllocs++;
+    return __real_malloc(size);
+}
+
+void *
+operator new(size_t size) {
+    nAllocs++;
+    void * p = __real_malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+
+// resident set size in kB
+static long
+rssKb() {
+    long size = 0, rss = 0;
+    FILE * fid = fopen("/proc/self/statm", "r");
+    if(fid) {
+        if(fscanf(fid, "%ld %ld", &size, &rss) != 2)
+            rss = 0;
+        fclose(fid);
+    }
+    return rss * 4;
+}
+
+// issues nCmds random commands, and returns false if the commands after the
+// warm up allocate memory or grow the resident set
+static bool
+stress(const char * name, ntx_api & ntx, uint32_t * tcdm, uint64_t nCmds) {
+
+    uint64_t allocs0 = 0;
+    long     rss0    = 0;
+
+    for(uint64_t c=0; c < nCmds; c++) {
+        if(c == C_N_WARMUP) {
+            ntx.idleWait();
+            allocs0 = nAllocs;
+            rss0    = rssKb();
+        }
+
+        // mostly short nests, and now and then a long row for the row and
+        // loop nest kernels
+        const uint32_t outer = 1 + rnd() % 3;
+        const uint32_t inner = rnd() % (outer + 1);
+        const uint32_t init  = inner + rnd() % (outer - inner + 1);
+
+        nst_loopType   loopBound;
+        nst_strideType aguStride;
+        for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+            loopBound[l] = 1 + rnd() % 4;
+        if(rnd() % 16 == 0)
+            loopBound[0] = 1 + rnd() % 256;
+        for(uint32_t o=0; o < C_N_AGUS; o++)
+            for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+                aguStride[o][l] = rnd() % 3;
+
+        ntx.stageLoopNest(init, inner, outer, loopBound, aguStride);
+        ntx.stageAguOffs(tcdm + rnd() % 4096, tcdm + 4096 + rnd() % 4096, tcdm + 8192 + rnd() % 4096);
+        ntx.stageCmd(rnd() % C_N_NTX_OPCODES, rnd() % 4, rnd() % 8, C_NTX_SET_CMD_IRQ, rnd() % 2);
+        ntx.issueCmd();
+    }
+    ntx.idleWait();
+
+    const uint64_t allocs = nAllocs - allocs0;
+    const long     rss    = rssKb();
+    const bool     ok     = allocs == 0 && rss - rss0 <= C_RSS_SLACK_KB;
+
+    printf("%-12s %9llu commands, %llu allocations after warm up, RSS %ld kB -> %ld kB: %s\n",
+           name, (unsigned long long)nCmds, (unsigned long long)allocs, rss0, rss, ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t nCmds = argc > 1 ? atoll(argv[1]) : 2000000;
+
+    uint32_t * tcdm = new uint32_t[C_TCDM_MEMSIZE];
+    for(uint32_t k=0; k < C_TCDM_MEMSIZE; k++)
+        tcdm[k] = floatTofp32((float)(int)(rnd() % 64) - 32.0f);
+
+    ntx_api ntx(0);
+    ntx.setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+
+    bool ok = stress("synchronous", ntx, tcdm, nCmds);
+
+    // the timing model and the worker thread are slower, fewer commands
+    ntx.setPerfModel(true);
+    ok &= stress("perf model", ntx, tcdm, nCmds / 10);
+    ntx.setPerfModel(false);
+
+    ntx.setAsyncMode(true);
+    ok &= stress("asynchronous", ntx, tcdm, nCmds / 10);
+    ntx.setAsyncMode(false);
+
+    delete [] tcdm;
+
+    return ok ? 0 : 1;
+}
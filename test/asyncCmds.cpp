@@ -0,0 +1,99 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// runs the same random commands on a synchronous NTX and on an asynchronous
+// one (see setAsyncMode), each on its own TCDM, and compares the TCDMs and
+// the NTX state after each batch. the asynchronous NTX issues the commands
+// back to back, so that the host stages the next command while the worker
+// executes the previous ones. it lives in a std::vector that grows in the
+// middle of each batch: the copy of the NTX must wait until it is idle and
+// start in synchronous mode, instead of sharing the worker of the old one.
+// the commands come from the generator of fuzzCmds (see rndCmds.hpp), and
+// the large ones are split across the thread pool by the worker, run it
+// with NTX_THREADS above one to cover the split.
+//
+// usage: asyncCmds [seeds] [commands per seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_api.hpp"
+#include "rndCmds.hpp"
+
+static void
+stage(ntx_api & ntx, const rndCmdType & cmd, uint32_t * tcdm) {
+    ntx.setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+    stageRndCmd(ntx, cmd, tcdm);
+}
+
+static bool
+sameState(ntx_api & a, const uint32_t * tcdmA, ntx_api & b, const uint32_t * tcdmB) {
+    return hashState(C_HASH_SEED, a, tcdmA) == hashState(C_HASH_SEED, b, tcdmB) &&
+           hashTcdm(C_HASH_SEED, tcdmA) == hashTcdm(C_HASH_SEED, tcdmB);
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint32_t nSeeds = argc > 1 ? atoi(argv[1]) : 16;
+    const uint32_t nCmds  = argc > 2 ? atoi(argv[2]) : 400;
+
+    std::vector<uint32_t>   tcdmSync(C_TCDM_MEMSIZE), tcdmAsync(C_TCDM_MEMSIZE);
+    std::vector<rndCmdType> cmds(nCmds);
+
+    uint32_t nErrors = 0;
+
+    for(uint32_t seed=1; seed <= nSeeds; seed++) {
+        rndState = seed;
+        for(uint32_t k=0; k < C_TCDM_MEMSIZE; k++)
+            tcdmSync[k] = tcdmAsync[k] = rndVal();
+        for(uint32_t c=0; c < nCmds; c++)
+            rndCmd(cmds[c]);
+
+        ntx_api ref(0);
+        for(uint32_t c=0; c < nCmds; c++) {
+            stage(ref, cmds[c], tcdmSync.data());
+            ref.issueCmd();
+        }
+
+        std::vector<ntx_api> ntxs(1);
+        ntxs[0].setAsyncMode(true);
+
+        bool moved = false;
+        for(uint32_t c=0; c < nCmds; c++) {
+            if(c == nCmds/2) {
+                // the reallocation copies the NTX while commands are in flight
+                ntxs.resize(ntxs.capacity() + 1);
+                moved = !ntxs[0].jobQueue && ntxs[0].isIdle();
+                ntxs[0].setAsyncMode(true);
+            }
+
+            stage(ntxs[0], cmds[c], tcdmAsync.data());
+            ntxs[0].issueCmd();
+
+            if(rnd() % 8 == 0)
+                ntxs[0].readyWait();
+        }
+        ntxs[0].idleWait();
+
+        const bool ok = sameState(ref, tcdmSync.data(), ntxs[0], tcdmAsync.data()) && (nCmds < 2 || moved);
+        if(!ok && nErrors++ < 10)
+            printf("  seed %u: %s\n", seed, moved ? "state differs" : "copy of the NTX still asynchronous");
+    }
+
+    printf("%u seeds, %u commands each: %s\n", nSeeds, nCmds, nErrors ? "FAILED" : "ok");
+
+    return nErrors ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// micro benchmark of the conversion of the multiplier output to the pcs
+// format, over the full exponent range. it compares the windowed version of
+// fp32_mac.cpp (a branch on the spill into the next word) with a version
+// that takes the word offset and the shifts from a table, and checks that
+// both give the same words. the table version did not pay off, see
+// extFp32ToPcs.
+//
+// usage: benchExtFp32 [conversions]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+
+#include "fp32_mac.hpp"
+#include "rnd.hpp"
+
+// windowed conversion, as in extFp32ToPcs
+static inline void
+extSparse(bool sign, int32_t exponent, uint64_t mantissa, fp32_accuType & output) {
+
+    output.neg = false;
+
+    if(exponent < 0) {
+        output.lo = C_FP32_N_ACCU_WORDS;
+        output.hi = -1;
+        return;
+    } else if(exponent >= C_FP32_EXP_MASK_ALIGNED) {
+        exponent = C_FP32_EXP_MASK_ALIGNED;
+        mantissa = (1ULL << (C_FP32_MANT_WIDTH*2));
+    }
+
+    if(!mantissa) {
+        output.lo = C_FP32_N_ACCU_WORDS;
+        output.hi = -1;
+        return;
+    }
+
+    int32_t  shiftSize = exponent - C_FP32_MANT_WIDTH;
+    int32_t  off       = 0;
+    uint64_t lower, upper = 0ULL;
+
+    if(shiftSize<0) {
+        lower = mantissa >> -shiftSize;
+    } else {
+        off        = shiftSize >> 6;
+        shiftSize &= 0x3F;
+        lower      = mantissa << shiftSize;
+        if((shiftSize + (2 + 2*C_FP32_MANT_WIDTH)) > 64)
+            upper = mantissa >> (64-shiftSize);
+    }
+
+    const uint64_t signMask = sign ? ~0ULL : 0ULL;
+    uint64_t carry = sign;
+
+    lower  = (lower ^ signMask) + carry;
+    carry &= (lower == 0ULL);
+    upper  = (upper ^ signMask) + carry;
+    carry &= (upper == 0ULL);
+
+    output.w[off]   = lower;
+    output.w[off+1] = upper;
+    output.lo       = off;
+    output.hi       = off+1;
+    output.neg      = sign && !carry;
+}
+
+// word offset and shifts per exponent, filled at compile time
+struct shiftType {
+    uint8_t off;
+    uint8_t lshift;
+    uint8_t rshift;
+};
+
+static constexpr shiftType
+shiftFor(const int32_t exp) {
+    return (exp < C_FP32_MANT_WIDTH) ?
+        shiftType{0, 0, (uint8_t)(C_FP32_MANT_WIDTH - exp)} :
+        shiftType{(uint8_t)((exp - C_FP32_MANT_WIDTH) >> 6),
+                  (uint8_t)((exp - C_FP32_MANT_WIDTH) & 0x3F),
+                  0};
+}
+
+#define SHIFT_4(e)   shiftFor(e), shiftFor(e+1), shiftFor(e+2), shiftFor(e+3)
+#define SHIFT_16(e)  SHIFT_4(e), SHIFT_4(e+4), SHIFT_4(e+8), SHIFT_4(e+12)
+#define SHIFT_64(e)  SHIFT_16(e), SHIFT_16(e+16), SHIFT_16(e+32), SHIFT_16(e+48)
+#define SHIFT_256(e) SHIFT_64(e), SHIFT_64(e+64), SHIFT_64(e+128), SHIFT_64(e+192)
+
+static constexpr shiftType shiftTable[C_FP32_EXP_MASK_ALIGNED+1] = {SHIFT_256(0)};
+
+// table driven conversion, without a branch on the spill
+static inline void
+extTable(bool sign, int32_t exponent, uint64_t mantissa, fp32_accuType & output) {
+
+    output.neg = false;
+
+    if(exponent < 0) {
+        output.lo = C_FP32_N_ACCU_WORDS;
+        output.hi = -1;
+        return;
+    } else if(exponent >= C_FP32_EXP_MASK_ALIGNED) {
+        exponent = C_FP32_EXP_MASK_ALIGNED;
+        mantissa = (1ULL << (C_FP32_MANT_WIDTH*2));
+    }
+
+    if(!mantissa) {
+        output.lo = C_FP32_N_ACCU_WORDS;
+        output.hi = -1;
+        return;
+    }
+
+    const shiftType sh  = shiftTable[exponent];
+    const int32_t   off = sh.off;
+
+    uint64_t lower = (mantissa >> sh.rshift) << sh.lshift;
+    uint64_t upper = (mantissa >> 1) >> (63 - sh.lshift);
+
+    const uint64_t signMask = sign ? ~0ULL : 0ULL;
+    uint64_t carry = sign;
+
+    lower  = (lower ^ signMask) + carry;
+    carry &= (lower == 0ULL);
+    upper  = (upper ^ signMask) + carry;
+    carry &= (upper == 0ULL);
+
+    output.w[off]   = lower;
+    output.w[off+1] = upper;
+    output.lo       = off;
+    output.hi       = off+1;
+    output.neg      = sign && !carry;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define C_N_OPS (1<<12)
+
+struct extOp {
+    bool     sign;
+    int32_t  exponent;
+    uint64_t mantissa;
+};
+
+static extOp ops[C_N_OPS];
+
+template <void (*EXT)(bool, int32_t, uint64_t, fp32_accuType &)>
+static double
+run(uint64_t n, uint64_t & sum) {
+    fp32_accuType acc;
+    double best = 1e30;
+    for(uint32_t rep=0; rep < 5; rep++) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for(uint64_t k=0; k < n; k++) {
+            const extOp & op = ops[k & (C_N_OPS-1)];
+            EXT(op.sign, op.exponent, op.mantissa, acc);
+            sum += acc.w[acc.hi & 1] + acc.hi;
+        }
+        const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        best = t < best ? t : best;
+    }
+    return best / n * 1e9;
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t n = argc > 1 ? atoll(argv[1]) : 20000000;
+
+    // products of random operands, over the full exponent range
+    for(uint32_t k=0; k < C_N_OPS; k++) {
+        const uint64_t r = rnd64();
+        ops[k].sign     = r >> 63;
+        ops[k].exponent = (int32_t)((r >> 32) % 300) - 20;
+        ops[k].mantissa = ((r >> 8) & ((1ULL << 48) - 1)) | (1ULL << 46);
+    }
+
+    for(uint32_t k=0; k < C_N_OPS; k++) {
+        fp32_accuType a, b;
+        extSparse(ops[k].sign, ops[k].exponent, ops[k].mantissa, a);
+        extTable (ops[k].sign, ops[k].exponent, ops[k].mantissa, b);
+        a.expand();
+        b.expand();
+        for(int32_t w=0; w < C_FP32_N_ACCU_WORDS; w++) {
+            if(a.w[w] != b.w[w]) {
+                printf("mismatch at operand %u\n", k);
+                return 1;
+            }
+        }
+    }
+
+    uint64_t sum = 0;
+    printf("branch on spill: %5.2f ns/conversion\n", run<extSparse>(n, sum));
+    printf("shift table:     %5.2f ns/conversion\n", run<extTable>(n, sum));
+    printf("(checksum %llx)\n", (unsigned long long)sum);
+
+    return 0;
+}
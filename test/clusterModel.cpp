@@ -0,0 +1,185 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the cycle model of ntx_cluster.hpp against hand-derived counts. all
+// cases run a single row of n steps that accumulates into one result, so
+// that the only write back comes at the end:
+//
+//   cycle 0        the controller takes the command
+//   cycle 1        init step (zero init, no read)
+//   cycle 2+k      step k is issued
+//   cycle 3+k      its operands are read, if the bank grants them
+//   read + 2       the FPU executes the step (the data arrives one cycle
+//                  after the read, and the FPU sees it in the next cycle)
+//   exec + 10      the result leaves the MAC pipeline (C_FP32_MAC_LAT) and
+//                  is written back, if the bank grants it
+//   write + 1      the cluster is idle, which is the cycle count
+//
+// without conflicts, this gives n+15 cycles, n+14 of them active. the FPU
+// executes a step per cycle, and the controller stays 3 steps ahead of it,
+// below the C_FPU_INPUT_FIFO_DEPTH credits. each case below derives where
+// lost arbitrations delay the reads and the write back.
+//
+// usage: clusterModel
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_cluster.hpp"
+
+#define C_TCDM_BYTES (1<<16)
+
+static uint32_t nErrors = 0;
+
+static void
+check(const char * what, uint64_t value, uint64_t expected) {
+    if(value != expected && nErrors++ < 20)
+        printf("  %s: %llu instead of %llu\n", what, (unsigned long long)value, (unsigned long long)expected);
+}
+
+// stages a row of n steps of opCode on ntx. operand A (agu0) and B (agu1)
+// start at the words a and b and step by strideA and strideB words, the
+// result goes to word c.
+static void
+stageRow(ntx_api & ntx, uint32_t * tcdm, uint32_t opCode, uint32_t n,
+         uint32_t a, int32_t strideA, uint32_t b, int32_t strideB, uint32_t c) {
+
+    nst_loopType   loopBound;
+    nst_strideType aguStride;
+    for(uint32_t l=0; l < C_N_HW_LOOPS; l++) {
+        loopBound[l] = 1;
+        for(uint32_t o=0; o < C_N_AGUS; o++)
+            aguStride[o][l] = 0;
+    }
+    loopBound[0]    = n;
+    aguStride[0][0] = strideA;
+    aguStride[1][0] = strideB;
+
+    ntx.stageLoopNest(1, 1, 1, loopBound, aguStride);
+    ntx.stageAguOffs(tcdm + a, tcdm + b, tcdm + c);
+    ntx.stageCmd(opCode, C_NTX_INIT_WITH_ZERO, 0, C_NTX_SET_CMD_IRQ, 0);
+}
+
+// one NTX, a dot product whose operands are 16 banks apart: no conflicts,
+// and the timeline above
+static void
+singleNtx() {
+    const uint32_t n = 1024;
+
+    ntxCluster cl(1, C_TCDM_BYTES);
+    stageRow(cl[0], cl.tcdm(), C_NTX_MAC_OP, n, 0, 1, 2048 + 16, 1, 8192);
+    cl[0].issueCmd();
+
+    const uint64_t cycles = cl.simulate();
+    const ntxTimingStats & s = cl.ntxStats(0);
+
+    check("single NTX: cycles",    cycles,         n + 15);
+    check("single NTX: active",    s.activeCycles, n + 14);
+    check("single NTX: steps",     s.steps,        n);
+    check("single NTX: MACs",      s.macs,         n);
+    check("single NTX: reads",     s.reads,        2*n);
+    check("single NTX: writes",    s.writes,       1);
+    check("single NTX: conflicts", s.conflicts,    0);
+    check("single NTX: stalls",    s.stallCycles,  0);
+}
+
+// two NTXs with the same dot product, operand A of both on bank 0 and B on
+// bank 1 (stride of C_NTX_CLUSTER_N_BANKS words), the results on banks 2
+// and 3. the ports of NTX k are 2k and 2k+1, and round robin starts at port
+// 0 in both banks, so NTX 0 gets both operands in cycles 3, 5, .., 2n+1 and
+// NTX 1 in cycles 4, 6, .., 2n+2. NTX 1 is executing the last step in cycle
+// 2n+4 and writes back in cycle 2n+14: 2n+15 cycles. NTX 0 loses both ports
+// in the n-1 cycles in between its reads, NTX 1 in the n cycles of the
+// reads of NTX 0.
+static void
+sameBank() {
+    const uint32_t n = 64;
+    const uint32_t b = C_NTX_CLUSTER_N_BANKS;
+
+    ntxCluster cl(2, C_TCDM_BYTES);
+    for(uint32_t k=0; k < 2; k++) {
+        stageRow(cl[k], cl.tcdm(), C_NTX_MAC_OP, n, 0, b, 1, b, 2 + k);
+        cl[k].issueCmd();
+    }
+
+    const uint64_t cycles = cl.simulate();
+
+    check("same bank: cycles", cycles, 2*n + 15);
+    for(uint32_t k=0; k < 2; k++) {
+        const ntxTimingStats & s = cl.ntxStats(k);
+        check("same bank: steps",     s.steps,     n);
+        check("same bank: reads",     s.reads,     2*n);
+        check("same bank: writes",    s.writes,    1);
+        check("same bank: conflicts", s.conflicts, k == 0 ? 2*(n-1) : 2*n);
+    }
+}
+
+// one NTX that sums a row (VADDSUB, operand A only) against a core that
+// requests the only bank in every cycle (load 1.0). the NTX requests it in
+// cycles 3.. for the reads, and once more for the write back. the core is
+// granted in all other cycles, and issues its next request right after, so
+// it loses exactly the n+1 cycles the NTX wins. the replay ends with the
+// write back of the NTX, and the pending core request is dropped: the core
+// issues cycles-(n+1)+1 requests.
+//   HI:  the NTX always wins: n+15 cycles
+//   RR:  NTX and core take turns in the conflicting cycles, starting with
+//        the NTX. it reads in cycles 3, 5, .., 2n+1, and loses n-1 times.
+//        after 2n-1 conflicts, the write back in cycle 2n+13 goes to the
+//        core and the NTX writes in cycle 2n+14: 2n+15 cycles, n conflicts
+//   7:1: the NTX wins 7 of 8 conflicts. read k takes place in cycle
+//        3+k+k/7, the last one in 3+(n-1)+(n-1)/7, which is 75 for n = 64
+//        with 9 lost reads. the write back in cycle 87 follows 73 conflicts
+//        (73 mod 8 = 1), so the NTX wins it: 88 cycles, 9 conflicts
+static void
+coreTraffic(uint8_t prio, const char * name, uint64_t cyclesRef, uint64_t conflictsRef) {
+    const uint32_t n = 64;
+
+    ntxCluster cl(1, C_TCDM_BYTES, 1);
+    cl.setCoreTraffic(1, 1.0);
+    cl[0].setTcdmPrio(prio);
+    stageRow(cl[0], cl.tcdm(), C_NTX_VADDSUB_OP, n, 0, 1, 0, 0, 1024);
+    cl[0].issueCmd();
+
+    const uint64_t cycles = cl.simulate();
+    const ntxTimingStats  & s = cl.ntxStats(0);
+    const ntxClusterStats & c = cl.stats();
+
+    char what[64];
+    snprintf(what, sizeof(what), "core traffic %s: cycles", name);
+    check(what, cycles, cyclesRef);
+    snprintf(what, sizeof(what), "core traffic %s: NTX conflicts", name);
+    check(what, s.conflicts, conflictsRef);
+    snprintf(what, sizeof(what), "core traffic %s: reads", name);
+    check(what, s.reads, n);
+    snprintf(what, sizeof(what), "core traffic %s: core conflicts", name);
+    check(what, c.coreConflicts, n + 1);
+    snprintf(what, sizeof(what), "core traffic %s: core requests", name);
+    check(what, c.coreReqs, cyclesRef - n);
+}
+
+int
+main(int argc, char ** argv) {
+
+    singleNtx();
+    sameBank();
+
+    const uint32_t n = 64;
+    coreTraffic(C_NTX_CTRL_PRIO_HI, "HI",  n + 15,   0);
+    coreTraffic(C_NTX_CTRL_PRIO_RR, "RR",  2*n + 15, n);
+    coreTraffic(C_NTX_CTRL_PRIO_71, "7:1", 88,       9);
+
+    printf("cluster model: %s\n", nErrors ? "FAILED" : "ok");
+
+    return nErrors ? 1 : 0;
+}
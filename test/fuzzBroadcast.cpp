@@ -0,0 +1,113 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// issues random commands on a broadcast NTX, and prints a hash of the TCDM
+// and of the state of all members after each batch of commands. most of the
+// commands are uniform (see issueBroadcast), and each member works in its
+// own part of the TCDM, so that the members share their loop control (see
+// nstRunSharedLoop) or run on the thread pool. the others have one member
+// with a different command, or overlapping members, and run one member
+// after the other. traced builds (-DNTX_TRACE_ON) with NTX_THREADS=1 run
+// each member on its own through the reference loop nest, so the output of
+// both builds must be the same for any number of threads (see the
+// fuzzbroadcast target in the Makefile).
+//
+// usage: fuzzBroadcast [seeds] [commands per seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_api.hpp"
+#include "rndCmds.hpp"
+
+#define C_MAX_MEMBERS  20
+
+int
+main(int argc, char ** argv) {
+
+    const uint32_t nSeeds = argc > 1 ? atoi(argv[1]) : 16;
+    const uint32_t nCmds  = argc > 2 ? atoi(argv[2]) : 200;
+
+    uint32_t * tcdm = new uint32_t[C_TCDM_MEMSIZE];
+
+    for(uint32_t seed=1; seed <= nSeeds; seed++) {
+        rndState = seed;
+        for(uint32_t k=0; k < C_TCDM_MEMSIZE; k++)
+            tcdm[k] = rndVal();
+
+        const uint32_t n    = 2 + rnd() % (C_MAX_MEMBERS - 1);
+        const int64_t  part = C_TCDM_MEMSIZE / n;
+
+        std::vector<ntx_api> ntxs(n);
+        for(uint32_t m=0; m < n; m++)
+            ntxs[m].setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+        ntx_api bcst(0, ntxs.data(), ntxs.data() + n);
+
+        uint64_t h = C_HASH_SEED;
+        for(uint32_t c=0; c < nCmds; c++) {
+            // large commands would not fit into the parts of the members
+            rndCmdType cmd;
+            rndCmd(cmd, false);
+
+            // extent [lo, hi] of the nest of each AGU, in words
+            int64_t lo[C_N_AGUS], hi[C_N_AGUS];
+            for(uint32_t o=0; o < C_N_AGUS; o++) {
+                lo[o] = hi[o] = 0;
+                for(uint32_t l=0; l < cmd.outer; l++) {
+                    const int64_t d = (int64_t)cmd.aguStride[o][l] * (cmd.loopBound[l] - 1);
+                    (d < 0 ? lo[o] : hi[o]) += d;
+                }
+            }
+
+            // each member within its own part of the TCDM, or anywhere
+            const bool apart = rnd() % 8 != 0;
+
+            bcst.stageLoopNest(cmd.init, cmd.inner, cmd.outer, cmd.loopBound, cmd.aguStride);
+            for(uint32_t m=0; m < n; m++) {
+                uint32_t * off[C_N_AGUS];
+                for(uint32_t o=0; o < C_N_AGUS; o++) {
+                    const int64_t size = hi[o] - lo[o] + 1;
+                    if(apart && size <= part)
+                        off[o] = tcdm + m * part - lo[o] + rnd() % (part - size + 1);
+                    else
+                        off[o] = tcdm + rndOff();
+                }
+                for(uint32_t o=0; o < 2; o++)
+                    if(cmd.inPlace[o])
+                        off[o] = off[2];
+                ntxs[m].stageAguOffs(off[0], off[1], off[2]);
+            }
+            bcst.stageCmd(cmd.opCode, cmd.initSel, cmd.auxFunc, C_NTX_SET_CMD_IRQ, cmd.polarity);
+
+            // one member with a different command
+            if(rnd() % 8 == 0) {
+                ntx_api & odd = ntxs[rnd() % n];
+                odd.stageCmd(rnd() % C_N_NTX_OPCODES, rnd() % 4, rnd() % 8, C_NTX_SET_CMD_IRQ, rnd() % 2);
+            }
+
+            bcst.issueCmd();
+
+            for(uint32_t m=0; m < n; m++)
+                h = hashState(h, ntxs[m], tcdm);
+        }
+        h = hashTcdm(h, tcdm);
+
+        printf("seed %u: %u members, %016llx\n", seed, n, (unsigned long long)h);
+    }
+
+    delete [] tcdm;
+
+    return 0;
+}
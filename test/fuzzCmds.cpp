@@ -0,0 +1,63 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// issues random commands on one NTX, and prints a hash of the TCDM and of
+// the NTX state after each batch of commands. traced builds (-DNTX_TRACE_ON)
+// run every command through the reference loop nest, without the row and
+// loop nest kernels, so the output of both builds must be the same (see the
+// fuzz target in the Makefile). some of the commands are large enough to be
+// split across the thread pool (see nstRunParallel), run it with NTX_THREADS
+// above one to cover the split.
+//
+// usage: fuzzCmds [seeds] [commands per seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_api.hpp"
+#include "rndCmds.hpp"
+
+int
+main(int argc, char ** argv) {
+
+    const uint32_t nSeeds = argc > 1 ? atoi(argv[1]) : 16;
+    const uint32_t nCmds  = argc > 2 ? atoi(argv[2]) : 400;
+
+    uint32_t * tcdm = new uint32_t[C_TCDM_MEMSIZE];
+
+    for(uint32_t seed=1; seed <= nSeeds; seed++) {
+        rndState = seed;
+        for(uint32_t k=0; k < C_TCDM_MEMSIZE; k++)
+            tcdm[k] = rndVal();
+
+        ntx_api ntx(0);
+        ntx.setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+
+        uint64_t h = C_HASH_SEED;
+        for(uint32_t c=0; c < nCmds; c++) {
+            rndCmdType cmd;
+            rndCmd(cmd);
+            stageRndCmd(ntx, cmd, tcdm);
+            ntx.issueCmd();
+            h = hashState(h, ntx, tcdm);
+        }
+        h = hashTcdm(h, tcdm);
+
+        printf("seed %u: %016llx\n", seed, (unsigned long long)h);
+    }
+
+    delete [] tcdm;
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the carry chain backends of pcsAdd and pcsInv (see pcsSetBackend)
+// bit by bit against the original full width implementation below, on
+// random accumulators with long runs of all ones words, with aliased
+// operands and outputs, and on MAC sequences whose products have narrow live
+// windows. backends that are not available on this host are skipped.
+//
+// usage: pcsBackends [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fp32_mac.hpp"
+#include "rnd.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// original implementation, on plain words
+///////////////////////////////////////////////////////////////////////////////
+
+struct refAccuType {
+    uint64_t w[C_FP32_N_ACCU_WORDS];
+};
+
+static void
+refInv(const refAccuType & in, refAccuType & out) {
+    uint64_t carryIn = 1ULL;
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        const uint64_t tmp = (~in.w[k]) + carryIn;
+        carryIn  = ((tmp < (~in.w[k])) || (tmp < carryIn)) ? 1ULL : 0ULL;
+        out.w[k] = tmp;
+    }
+}
+
+static void
+refAdd(const refAccuType & opA, const refAccuType & opB, refAccuType & out) {
+    uint64_t carryIn = 0ULL, carryOut;
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        uint64_t tmp = opA.w[k] + opB.w[k];
+        if((tmp < opA.w[k]) || (tmp < opB.w[k]))
+            carryOut = 1ULL;
+        else if((carryIn == 1ULL) && (tmp == 0xFFFFFFFFFFFFFFFFULL))
+            carryOut = 1ULL;
+        else
+            carryOut = 0ULL;
+        tmp     += carryIn;
+        carryIn  = carryOut;
+        out.w[k] = tmp;
+    }
+    const uint32_t shift = 64 - (C_FP32_PCS_WIDTH & 0x3F);
+    out.w[C_FP32_N_ACCU_WORDS-1] = (int64_t)(out.w[C_FP32_N_ACCU_WORDS-1] << shift) >> shift;
+}
+
+static void
+refExtFp32ToPcs(bool sign, int32_t exponent, uint64_t mantissa, refAccuType & output) {
+    memset(output.w, 0, sizeof(output.w));
+    if(exponent < 0)
+        return;
+    if(exponent >= C_FP32_EXP_MASK_ALIGNED) {
+        exponent = C_FP32_EXP_MASK_ALIGNED;
+        mantissa = (1ULL << (C_FP32_MANT_WIDTH*2));
+    }
+    int32_t shiftSize = exponent - C_FP32_MANT_WIDTH;
+    if(shiftSize < 0) {
+        output.w[0] = mantissa >> -shiftSize;
+    } else {
+        const int32_t off = shiftSize >> 6;
+        shiftSize &= 0x3F;
+        output.w[off] = mantissa << shiftSize;
+        if((shiftSize + (2 + 2*C_FP32_MANT_WIDTH)) > 64)
+            output.w[off+1] = mantissa >> (64-shiftSize);
+    }
+    if(sign)
+        refInv(output, output);
+}
+
+static uint32_t
+refToFp32(const refAccuType & input) {
+    refAccuType tmp = input;
+    uint32_t output = 0;
+    if(input.w[C_FP32_N_ACCU_WORDS-1] >> 63) {
+        output = C_FP32_SIGN_MASK;
+        refInv(input, tmp);
+    }
+    int32_t tmpExp = C_FP32_N_ACCU_WORDS * 64 - C_FP32_MANT_WIDTH - 1;
+    int32_t lzCnt  = 0, off = 0;
+    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>=0; k--) {
+        off = k;
+        if(tmp.w[k]) {
+            lzCnt   = __builtin_clzll(tmp.w[k]);
+            tmpExp -= lzCnt;
+            break;
+        }
+        tmpExp -= 64;
+    }
+    if(tmpExp < 0)
+        return output | C_FP32_ZERO_VAL;
+    if(tmpExp >= C_FP32_EXP_MASK_ALIGNED)
+        return output | C_FP32_INF_VAL;
+    output |= tmpExp << C_FP32_MANT_WIDTH;
+    lzCnt = 64-1-C_FP32_MANT_WIDTH-lzCnt;
+    if(lzCnt >= 0) {
+        output |= (tmp.w[off] >> lzCnt) & C_FP32_MANT_MASK;
+    } else {
+        output |= (tmp.w[off] << -lzCnt) & C_FP32_MANT_MASK;
+        output |= (tmp.w[off-1] >> (64 + lzCnt));
+    }
+    return output;
+}
+
+static void
+refMac(uint32_t opA, uint32_t opB, bool accuSel, bool subEn, bool normEn, refAccuType & accu, uint32_t & res) {
+    int32_t  exponent = fp32_getExp(opA) + fp32_getExp(opB) - C_FP32_BIAS;
+    uint64_t mantissa = (uint64_t)fp32_getMantFull(opA) * (uint64_t)fp32_getMantFull(opB);
+    if(fp32_isZero(opA) || fp32_isZero(opB)) {
+        mantissa = 0ULL;
+        exponent = 0;
+    }
+    refAccuType tmp;
+    refExtFp32ToPcs((fp32_getSign(opA) ^ fp32_getSign(opB)) ^ subEn, exponent, mantissa, tmp);
+    if(accuSel)
+        accu = tmp;
+    else
+        refAdd(tmp, accu, accu);
+    if(normEn)
+        res = refToFp32(accu);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// random operands
+///////////////////////////////////////////////////////////////////////////////
+
+// accumulator with runs of all ones and all zeros words, and words that
+// overflow on the next carry. the top word is sign extended above the
+// overflow guard bits, like all accumulators of the model.
+static void
+rndAccu(refAccuType & a) {
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        switch(rnd() % 8) {
+            case 0:  a.w[k] = 0ULL;              break;
+            case 1:
+            case 2:  a.w[k] = ~0ULL;             break;
+            case 3:  a.w[k] = ~0ULL - rnd() % 4; break;
+            case 4:  a.w[k] = rnd() % 4;         break;
+            case 5:  a.w[k] = 1ULL << 63;        break;
+            default: a.w[k] = rnd64();           break;
+        }
+    }
+    const uint32_t shift = 64 - (C_FP32_PCS_WIDTH & 0x3F);
+    a.w[C_FP32_N_ACCU_WORDS-1] = (int64_t)(a.w[C_FP32_N_ACCU_WORDS-1] << shift) >> shift;
+}
+
+// fp32 operand of a MAC, most of them with similar exponents
+static uint32_t
+rndFp32() {
+    switch(rnd() % 16) {
+        case 0:  return C_FP32_ZERO_VAL;
+        case 1:  return (rnd() & 0x80000000) | C_FP32_INF_VAL;
+        case 2:  return rnd();
+        case 3:  return (rnd() & 0x807FFFFF) | ((rnd() % 4) << 23);
+        default: return (rnd() & 0x807FFFFF) | ((100 + rnd() % 50) << 23);
+    }
+}
+
+static void
+toModel(const refAccuType & in, fp32_accuType & out) {
+    out.clear();
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+        out.w[k] = in.w[k];
+}
+
+static bool
+same(const fp32_accuType & a, const refAccuType & b) {
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+        if(a.w[k] != b.w[k])
+            return false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// checks of one backend
+///////////////////////////////////////////////////////////////////////////////
+
+static uint64_t nErrors = 0;
+
+static void
+check(bool ok, const char * what, uint64_t it) {
+    if(ok)
+        return;
+    if(nErrors < 10)
+        printf("  mismatch in %s, iteration %llu\n", what, (unsigned long long)it);
+    nErrors++;
+}
+
+static void
+checkBackend(uint64_t nIters) {
+
+    for(uint64_t it=0; it < nIters; it++) {
+        refAccuType   ra, rb, rr;
+        fp32_accuType a, b, r;
+        rndAccu(ra);
+        rndAccu(rb);
+        toModel(ra, a);
+        toModel(rb, b);
+
+        // separate outputs
+        refAdd(ra, rb, rr);
+        pcsAdd(a, b, r);
+        check(same(r, rr), "pcsAdd", it);
+
+        refInv(ra, rr);
+        pcsInv(a, r);
+        check(same(r, rr), "pcsInv", it);
+
+        // aliased outputs
+        fp32_accuType x = a;
+        pcsAdd(x, b, x);
+        refAdd(ra, rb, rr);
+        check(same(x, rr), "pcsAdd(a, b, a)", it);
+
+        x = b;
+        pcsAdd(a, x, x);
+        check(same(x, rr), "pcsAdd(a, b, b)", it);
+
+        x = a;
+        pcsAdd(x, x, x);
+        refAdd(ra, ra, rr);
+        check(same(x, rr), "pcsAdd(a, a, a)", it);
+
+        pcsAdd(a, a, r);
+        check(same(r, rr), "pcsAdd(a, a, r)", it);
+
+        x = a;
+        pcsInv(x, x);
+        refInv(ra, rr);
+        check(same(x, rr), "pcsInv(a, a)", it);
+
+        // normalization, which inverts negative accumulators
+        uint32_t res;
+        pcsToFp32(a, res);
+        check(res == refToFp32(ra), "pcsToFp32", it);
+    }
+
+    // MAC sequences. the products only span one or two words, which are
+    // added with their live window.
+    for(uint64_t it=0; it < nIters / 16; it++) {
+        refAccuType   ra;
+        fp32_accuType a;
+        rndAccu(ra);
+        toModel(ra, a);
+
+        for(uint32_t k=0; k < 16; k++) {
+            const uint32_t opA     = rndFp32();
+            const uint32_t opB     = rndFp32();
+            const bool     accuSel = rnd() % 8 == 0;
+            const bool     subEn   = rnd() % 2;
+            const bool     normEn  = rnd() % 2;
+            uint32_t resRef = 0, res = 0;
+            refMac(opA, opB, accuSel, subEn, normEn, ra, resRef);
+            pcsMac(opA, opB, accuSel, subEn, normEn, a, res);
+            check(same(a, ra) && res == resRef, "pcsMac", it);
+        }
+    }
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t nIters = argc > 1 ? atoll(argv[1]) : 1000000;
+
+    static const struct {
+        uint32_t     backend;
+        const char * name;
+    } backends[] = {
+        {C_FP32_PCS_BACKEND_REF,      "reference"},
+        {C_FP32_PCS_BACKEND_PORTABLE, "portable"},
+        {C_FP32_PCS_BACKEND_ADX,      "ADX"},
+    };
+
+    const uint32_t startup = pcsGetBackend();
+
+    for(const auto & b : backends) {
+        if(!pcsHasBackend(b.backend)) {
+            printf("%-10s backend: not available, skipped\n", b.name);
+            continue;
+        }
+        const uint64_t nErrorsBefore = nErrors;
+        pcsSetBackend(b.backend);
+        rndState = 1;
+        checkBackend(nIters);
+        printf("%-10s backend: %s\n", b.name, nErrors == nErrorsBefore ? "ok" : "FAILED");
+    }
+
+    pcsSetBackend(startup);
+
+    return nErrors ? 1 : 0;
+}
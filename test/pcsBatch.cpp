@@ -0,0 +1,161 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the batched conversion pcsToFp32Batch against pcsToFp32, with the
+// AVX-512 version (if the host supports it) and with the portable one (see
+// pcsSetBatchAvx512). the accumulators are random, negative, zero, tiny,
+// saturated, and have runs of all ones words. some of them have a narrow
+// live window with garbage in the words outside of it, like the temporaries
+// of fp32_mac.cpp. every batch length from 0 to 3 AVX-512 blocks is
+// converted at random offsets, so that all tail lengths are covered.
+//
+// usage: pcsBatch [batches]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "fp32_mac.hpp"
+#include "rnd.hpp"
+
+#define C_N_ACCUS   4096
+#define C_MAX_BATCH 24
+
+// random word, with all zeros and all ones words now and then
+static uint64_t
+rndWord() {
+    switch(rnd() % 8) {
+        case 0:  return 0ULL;
+        case 1:  return ~0ULL;
+        case 2:  return 1ULL << (rnd() % 64);
+        default: return rnd64();
+    }
+}
+
+// random valid accumulator with the full window. the words are brought into
+// the range of the pcs format by adding zero, which masks the overflow bits.
+static void
+rndAccu(fp32_accuType & acc) {
+    fp32_accuType raw, zero;
+    zero.clear();
+
+    const int32_t top = rnd() % C_FP32_N_ACCU_WORDS;
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+        raw.w[k] = (k <= top) ? rndWord() : 0ULL;
+
+    pcsAdd(raw, zero, acc);
+
+    if(rnd() % 2)
+        pcsInv(acc, acc);
+}
+
+// narrows the window of acc to the words that differ from zero (below) and
+// the sign extension (above), and fills the words outside of the window
+// with garbage
+static void
+narrowWindow(fp32_accuType & acc) {
+    acc.neg = acc.isNeg();
+    const uint64_t ext = acc.neg ? ~0ULL : 0ULL;
+    int32_t lo = 0, hi = C_FP32_N_ACCU_WORDS-1;
+    while(hi >= lo && acc.w[hi] == ext)
+        hi--;
+    while(lo <= hi && acc.w[lo] == 0ULL)
+        lo++;
+    if(lo > hi)
+        lo = C_FP32_N_ACCU_WORDS;
+
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+        if(k < lo || k > hi)
+            acc.w[k] = rnd64();
+    acc.lo = lo;
+    acc.hi = hi;
+}
+
+static uint64_t nErrors = 0;
+
+static void
+checkBatches(const char * name, const fp32_accuType * acc, const fp32 * ref, uint64_t nBatches) {
+
+    uint64_t nErrorsBefore = nErrors;
+    fp32     out[C_MAX_BATCH + 1];
+
+    for(uint64_t b=0; b < nBatches; b++) {
+        const uint32_t n   = b % (C_MAX_BATCH + 1);
+        const uint32_t off = rnd() % (C_N_ACCUS - C_MAX_BATCH);
+
+        // the element behind the batch must not be written
+        out[n] = 0xDEADBEEF;
+        pcsToFp32Batch(acc + off, out, n);
+
+        for(uint32_t k=0; k < n; k++)
+            if(out[k] != ref[off+k] && nErrors++ < 10)
+                printf("  %s: accumulator %u of a batch of %u: %08X instead of %08X\n",
+                       name, off+k, n, out[k], ref[off+k]);
+        if(out[n] != 0xDEADBEEF && nErrors++ < 10)
+            printf("  %s: batch of %u writes behind its end\n", name, n);
+    }
+
+    printf("%-8s %s\n", name, nErrors == nErrorsBefore ? "ok" : "FAILED");
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t nBatches = argc > 1 ? atoll(argv[1]) : 200000;
+
+    static fp32_accuType acc[C_N_ACCUS];
+    static fp32          ref[C_N_ACCUS];
+
+    for(uint32_t k=0; k < C_N_ACCUS; k++) {
+        switch(rnd() % 8) {
+            case 0:
+                // zero, or the smallest values
+                acc[k].clear();
+                acc[k].w[0] = rnd() % 4;
+                if(rnd() % 2)
+                    pcsInv(acc[k], acc[k]);
+                break;
+            case 1: {
+                // products over the full exponent range, including the cut
+                // at the bottom and the saturated ones
+                const uint32_t opA = rnd(), opB = rnd();
+                uint32_t res;
+                pcsMac(opA & ~C_FP32_EXP_MASK, opB, 1, rnd() % 2, 0, acc[k], res);
+                pcsMac(opA, opB, 0, rnd() % 2, 0, acc[k], res);
+                break;
+            }
+            default:
+                rndAccu(acc[k]);
+                break;
+        }
+
+        if(rnd() % 4 == 0)
+            narrowWindow(acc[k]);
+
+        pcsToFp32(acc[k], ref[k]);
+    }
+
+    const bool avx512 = pcsHasBatchAvx512();
+
+    if(avx512) {
+        pcsSetBatchAvx512(true);
+        checkBatches("AVX-512", acc, ref, nBatches);
+    } else {
+        printf("AVX-512  not available, skipped\n");
+    }
+
+    pcsSetBatchAvx512(false);
+    checkBatches("portable", acc, ref, nBatches);
+
+    pcsSetBatchAvx512(avx512);
+
+    return nErrors ? 1 : 0;
+}
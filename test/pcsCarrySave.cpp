@@ -0,0 +1,122 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the deferred carry accumulator (see fp32_csAccuType) against pcsMac.
+// random MAC sequences run on pcsMacCs and on pcsMac, and after every step
+// the result and the accumulator words (through csToPcs) must match bit by
+// bit. the carries are resolved at random points: explicitly with
+// pcsCsResolve, by a round trip through pcsToCs and csToPcs, and by setting
+// the pending count to C_FP32_CS_MAX_PENDING, which forces the resolve inside
+// of the next addition as if the limit were tiny.
+//
+// usage: pcsCarrySave [MAC sequences]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "fp32_mac.hpp"
+#include "rnd.hpp"
+
+#define C_SEQ_LEN 64
+
+static bool
+same(const fp32_accuType & a, const fp32_accuType & b) {
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+        if(a.word(k) != b.word(k))
+            return false;
+    return true;
+}
+
+// all segments but the top one are in [0, 2^C_FP32_CS_SEG_LEN) after a
+// resolve, and nothing is pending
+static bool
+resolved(const fp32_csAccuType & a) {
+    for(int32_t k = 0; k<C_FP32_CS_N_SEGS-1; k++)
+        if(a.w[k] < 0 || a.w[k] >> C_FP32_CS_SEG_LEN)
+            return false;
+    return a.pending == 0;
+}
+
+static uint64_t nErrors = 0;
+
+static void
+check(bool ok, const char * what, uint64_t seq, uint32_t step) {
+    if(!ok && nErrors++ < 10)
+        printf("  %s: mismatch in sequence %llu, MAC %u\n", what, (unsigned long long)seq, step);
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t nSeqs = argc > 1 ? atoll(argv[1]) : 50000;
+
+    uint64_t nResolves = 0;
+
+    for(uint64_t s=0; s < nSeqs; s++) {
+        fp32_csAccuType cs;
+        fp32_accuType   ref, tmp;
+
+        // one in four sequences stays in a narrow exponent range
+        const bool    narrow = rnd() % 4 == 0;
+        const int32_t expLo  = narrow ? 100 + rnd() % 20 : 0;
+        const int32_t expHi  = narrow ? expLo + 4 : C_FP32_EXP_MASK_ALIGNED;
+
+        for(uint32_t k=0; k < C_SEQ_LEN; k++) {
+            const uint32_t opA     = rndOp(expLo, expHi);
+            const uint32_t opB     = rndOp(expLo, expHi);
+            const bool     accuSel = k == 0 || rnd() % 32 == 0;
+            const bool     subEn   = rnd() % 2;
+            const bool     normEn  = rnd() % 2;
+            uint32_t res = 0, resRef = 0;
+
+            switch(rnd() % 8) {
+                case 0:
+                    cs.pending = C_FP32_CS_MAX_PENDING;
+                    nResolves++;
+                    break;
+                case 1:
+                    pcsCsResolve(cs);
+                    check(resolved(cs), "pcsCsResolve", s, k);
+                    nResolves++;
+                    break;
+                case 2:
+                    csToPcs(cs, tmp);
+                    pcsToCs(tmp, cs);
+                    check(resolved(cs), "pcsToCs", s, k);
+                    nResolves++;
+                    break;
+                default:
+                    break;
+            }
+
+            pcsMacCs(opA, opB, accuSel, subEn, normEn, cs, res);
+            pcsMac(opA, opB, accuSel, subEn, normEn, ref, resRef);
+
+            check(!normEn || res == resRef, "result", s, k);
+
+            csToPcs(cs, tmp);
+            check(same(tmp, ref), "accumulator", s, k);
+
+            // a pcs accumulator survives the round trip unchanged
+            fp32_csAccuType rt;
+            pcsToCs(ref, rt);
+            csToPcs(rt, tmp);
+            check(same(tmp, ref), "round trip", s, k);
+        }
+    }
+
+    printf("%llu MAC steps, %llu forced resolves: %s\n",
+           (unsigned long long)(nSeqs * C_SEQ_LEN), (unsigned long long)nResolves,
+           nErrors ? "FAILED" : "ok");
+
+    return nErrors ? 1 : 0;
+}
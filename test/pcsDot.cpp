@@ -0,0 +1,187 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the batched dot product pcsMacDot against a loop of pcsMac calls,
+// bit by bit. the strides are 0, +-1 and large positive and negative numbers
+// of elements. the lengths are short, long, and around the point where the
+// pending carries have to be resolved: the accumulator starts with a pending
+// count just below C_FP32_CS_MAX_PENDING, so that the resolve happens at the
+// start, in the middle or at the end of the dot product.
+//
+// the parallel version pcsMacDotParallel must give the same accumulator as
+// the sequential loop, for several numbers of chunks and for lengths around
+// multiples of C_FP32_PAR_MIN_CHUNK, where the number of chunks changes. the
+// chunks run on the thread pool of the emulator, set NTX_THREADS to run them
+// on more than one thread (see ntx_pool.hpp).
+//
+// usage: pcsDot [dot products]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#include "fp32_mac.hpp"
+#include "ntx_pool.hpp"
+#include "rnd.hpp"
+
+#define C_MAX_LEN    2048
+#define C_BIG_STRIDE 1031
+
+static bool
+same(const fp32_accuType & a, const fp32_accuType & b) {
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++)
+        if(a.word(k) != b.word(k))
+            return false;
+    return true;
+}
+
+static uint64_t nErrors = 0;
+
+static void
+check(bool ok, const char * what, uint64_t it) {
+    if(!ok && nErrors++ < 10)
+        printf("  %s: mismatch in dot product %llu\n", what, (unsigned long long)it);
+}
+
+// random stride in elements: 0, +-1 or large
+static int32_t
+rndStride() {
+    switch(rnd() % 4) {
+        case 0:  return 0;
+        case 1:  return (rnd() % 2) ? 1 : -1;
+        default: return (rnd() % 2) ? C_BIG_STRIDE : -C_BIG_STRIDE;
+    }
+}
+
+// random length: short, long, or around the headroom left in the
+// accumulator
+static uint32_t
+rndLength(uint32_t headroom) {
+    switch(rnd() % 4) {
+        case 0:  return rnd() % 8;
+        case 1:  return rnd() % C_MAX_LEN;
+        default: return std::min(C_MAX_LEN - 1U, headroom - 2 + rnd() % 5);
+    }
+}
+
+// start of a vector with n elements and the given stride within buf, so
+// that negative strides stay inside of it as well
+static const uint32_t *
+vecStart(const std::vector<uint32_t> & buf, int32_t stride, uint32_t n) {
+    return buf.data() + (stride < 0 ? (int64_t)(n ? n-1 : 0) * -stride : 0);
+}
+
+static void
+checkDot(const std::vector<uint32_t> & bufA, const std::vector<uint32_t> & bufB, uint64_t nDots) {
+
+    for(uint64_t it=0; it < nDots; it++) {
+        const int32_t  strideA = rndStride();
+        const int32_t  strideB = rndStride();
+        const bool     subEn   = rnd() % 2;
+        const uint32_t headrm  = 2 + rnd() % (C_MAX_LEN / 2);
+        const uint32_t nInit   = 1 + rnd() % 4;
+        const uint32_t n       = rndLength(headrm);
+
+        // the same start value in both accumulators, with a few carries
+        // pending in the deferred carry one
+        fp32_csAccuType cs;
+        fp32_accuType   ref, tmp;
+        uint32_t        res, resRef;
+        for(uint32_t k=0; k < nInit; k++) {
+            const uint32_t opA = rndOp(), opB = rndOp();
+            pcsMacCs(opA, opB, k == 0, 0, 0, cs, res);
+            pcsMac(opA, opB, k == 0, 0, 0, ref, resRef);
+        }
+        if(rnd() % 2)
+            cs.pending = C_FP32_CS_MAX_PENDING - headrm;
+
+        const uint32_t * a = vecStart(bufA, strideA, n);
+        const uint32_t * b = vecStart(bufB, strideB, n);
+
+        pcsMacDot(a, strideA * 4, b, strideB * 4, n, subEn, cs);
+        for(uint32_t k=0; k < n; k++)
+            pcsMac(a[(int64_t)k * strideA], b[(int64_t)k * strideB], 0, subEn, 0, ref, resRef);
+
+        csToPcs(cs, tmp);
+        check(same(tmp, ref), "pcsMacDot", it);
+
+        pcsToFp32(tmp, res);
+        pcsToFp32(ref, resRef);
+        check(res == resRef, "pcsMacDot result", it);
+    }
+
+    printf("pcsMacDot          %s\n", nErrors ? "FAILED" : "ok");
+}
+
+static void
+checkDotParallel(const std::vector<uint32_t> & bufA, const std::vector<uint32_t> & bufB) {
+
+    static const uint32_t threads[] = {0, 1, 2, 3, 4, 7, 8, C_FP32_PAR_MAX_CHUNKS};
+    static const uint32_t chunks[]  = {0, 1, 2, 3, 5, 8};
+
+    uint64_t nErrorsBefore = nErrors;
+    uint64_t it = 0;
+
+    for(uint32_t t : threads) {
+        for(uint32_t c : chunks) {
+            for(int32_t d = -1; d <= 1; d++, it++) {
+                if(c == 0 && d < 0)
+                    continue;
+
+                // the large strides of checkDot do not fit into the buffers
+                // for these lengths
+                const uint32_t n       = c * C_FP32_PAR_MIN_CHUNK + d;
+                const int32_t  strideA = (int32_t)(rnd() % 5) - 2;
+                const int32_t  strideB = (int32_t)(rnd() % 5) - 2;
+                const bool     subEn   = rnd() % 2;
+
+                fp32_accuType acc, ref;
+                uint32_t      res, resRef;
+                for(uint32_t k=0; k < 3; k++) {
+                    const uint32_t opA = rndOp(), opB = rndOp();
+                    pcsMac(opA, opB, k == 0, 0, 0, acc, res);
+                    pcsMac(opA, opB, k == 0, 0, 0, ref, resRef);
+                }
+
+                const uint32_t * a = vecStart(bufA, strideA, n);
+                const uint32_t * b = vecStart(bufB, strideB, n);
+
+                pcsMacDotParallel(a, strideA * 4, b, strideB * 4, n, subEn, t, ntxPoolRun, acc);
+                for(uint32_t k=0; k < n; k++)
+                    pcsMac(a[(int64_t)k * strideA], b[(int64_t)k * strideB], 0, subEn, 0, ref, resRef);
+
+                check(same(acc, ref), "pcsMacDotParallel", it);
+            }
+        }
+    }
+
+    printf("pcsMacDotParallel  %s (%u pool threads)\n", nErrors == nErrorsBefore ? "ok" : "FAILED",
+           ntxThreadPool::instance().size());
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t nDots = argc > 1 ? atoll(argv[1]) : 4000;
+
+    // room for C_MAX_LEN elements at the largest stride
+    std::vector<uint32_t> bufA((size_t)C_MAX_LEN * C_BIG_STRIDE), bufB(bufA.size());
+    for(size_t k=0; k < bufA.size(); k++) {
+        bufA[k] = rndOp();
+        bufB[k] = rndOp();
+    }
+
+    checkDot(bufA, bufB, nDots);
+    checkDotParallel(bufA, bufB);
+
+    return nErrors ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the templated MAC model of pcs_mac.hpp against pcsMac. the fp32
+// instantiation must match pcsMac bit by bit, including the accumulator. the
+// bf16 and fp16 operands are widened to fp32 for pcsMac, which is exact, and
+// the fp32 result is truncated to the narrow format. the operands are chosen
+// such that no bits are cut at the bottom of the narrow accumulators, and
+// that the fp16 accumulator does not overflow.
+//
+// usage: pcsFormats [MAC sequences]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "fp32_mac.hpp"
+#include "pcs_mac.hpp"
+#include "rnd.hpp"
+
+#define C_SEQ_LEN 16
+
+// exact fp32 encoding of a value of format F
+template <class F>
+static uint32_t
+toFp32(uint32_t in) {
+    if(F::isZero(in))
+        return F::getSign(in) ? C_FP32_SIGN_MASK : C_FP32_ZERO_VAL;
+    const uint32_t exp = F::getExp(in) - F::bias + C_FP32_BIAS;
+    return (F::getSign(in) ? C_FP32_SIGN_MASK : 0) | (exp << C_FP32_MANT_WIDTH) |
+           ((in & F::mantMask) << (C_FP32_MANT_WIDTH - F::mantWidth));
+}
+
+// fp32 result truncated to format F, with the same underflow to zero and
+// saturation to infinity as pcsToFmt
+template <class F>
+static uint32_t
+fromFp32(uint32_t in) {
+    const uint32_t sign = (in & C_FP32_SIGN_MASK) ? F::signMask : 0;
+    const int32_t  exp  = fp32_getExp(in) - C_FP32_BIAS + F::bias;
+    if((in & ~C_FP32_SIGN_MASK) == 0 || exp < 0)
+        return sign;
+    if(exp >= F::maxExp)
+        return sign | F::infVal;
+    return sign | ((uint32_t)exp << F::mantWidth) |
+           ((in & C_FP32_MANT_MASK) >> (C_FP32_MANT_WIDTH - F::mantWidth));
+}
+
+static uint64_t nErrors = 0;
+
+// runs nSeqs MAC sequences on the model of format F and on pcsMac. words
+// compares the accumulators too (fp32 only).
+template <class A>
+static void
+checkFormat(const char * name, uint64_t nSeqs, int32_t expLo, int32_t expHi, bool words) {
+
+    typedef typename A::format F;
+    uint64_t nErrorsBefore = nErrors;
+
+    for(uint64_t s=0; s < nSeqs; s++) {
+        A             acc;
+        fp32_accuType ref;
+        acc.clear();
+        ref.clear();
+
+        for(uint32_t k=0; k < C_SEQ_LEN; k++) {
+            const uint32_t opA     = rndOp<F>(expLo, expHi);
+            const uint32_t opB     = rndOp<F>(expLo, expHi);
+            const bool     accuSel = k == 0 || rnd() % 8 == 0;
+            const bool     subEn   = rnd() % 2;
+            const bool     normEn  = rnd() % 2;
+            uint32_t res = 0, resRef = 0;
+
+            pcsMacFmt(opA, opB, accuSel, subEn, normEn, acc, res);
+            pcsMac(toFp32<F>(opA), toFp32<F>(opB), accuSel, subEn, normEn, ref, resRef);
+
+            bool ok = !normEn || res == fromFp32<F>(resRef);
+            for(uint32_t w=0; words && w < C_FP32_N_ACCU_WORDS; w++)
+                ok &= acc.w[w] == ref.w[w];
+
+            if(!ok && nErrors++ < 10)
+                printf("  %s: mismatch in sequence %llu, MAC %u\n", name, (unsigned long long)s, k);
+        }
+    }
+
+    printf("%-5s %s\n", name, nErrors == nErrorsBefore ? "ok" : "FAILED");
+}
+
+int
+main(int argc, char ** argv) {
+
+    const uint64_t nSeqs = argc > 1 ? atoll(argv[1]) : 125000;
+
+    // fp32 over the full exponent range, including saturated products
+    checkFormat<pcsAccuFp32>("fp32", nSeqs, 0, fmtFp32::maxExp, true);
+
+    // products above the bottom of the bf16 accumulator
+    checkFormat<pcsAccuBf16>("bf16", nSeqs, 70, 250, false);
+
+    // products above the bottom of the fp16 accumulator, and sums of
+    // C_SEQ_LEN products below its overflow bits
+    checkFormat<pcsAccuFp16>("fp16", nSeqs, 13, 22, false);
+
+    return nErrors ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the direct product pcsMul of VMULT and OUTERP against pcsMac with
+// accuSel = normEn = 1, exhaustively over all pairs of exponents (including
+// zero and the maximum exponent), both signs of both operands and subEn. per
+// combination, the smallest and the largest mantissas and a few random ones
+// are used, so that the products fall on both sides of the carry into bit 47.
+//
+// usage: pcsMul [random mantissas per combination]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "fp32_mac.hpp"
+#include "rnd.hpp"
+
+int
+main(int argc, char ** argv) {
+
+    const uint32_t nRnd = argc > 1 ? atoi(argv[1]) : 4;
+
+    uint64_t nChecks = 0, nErrors = 0;
+
+    for(uint32_t expA=0; expA <= C_FP32_EXP_MASK_ALIGNED; expA++) {
+        for(uint32_t expB=0; expB <= C_FP32_EXP_MASK_ALIGNED; expB++) {
+            for(uint32_t signs=0; signs < 8; signs++) {
+                const uint32_t signA = (signs & 1) ? C_FP32_SIGN_MASK : 0;
+                const uint32_t signB = (signs & 2) ? C_FP32_SIGN_MASK : 0;
+                const uint8_t  subEn = (signs >> 2) & 1;
+
+                for(uint32_t m=0; m < 4 + nRnd; m++) {
+                    uint32_t mantA, mantB;
+                    switch(m) {
+                        case 0:  mantA = 0;                mantB = 0;                break;
+                        case 1:  mantA = C_FP32_MANT_MASK; mantB = C_FP32_MANT_MASK; break;
+                        case 2:  mantA = 0;                mantB = C_FP32_MANT_MASK; break;
+                        case 3:  mantA = 1;                mantB = C_FP32_MANT_MASK; break;
+                        default: mantA = rnd() & C_FP32_MANT_MASK;
+                                 mantB = rnd() & C_FP32_MANT_MASK;                   break;
+                    }
+
+                    const fp32 opA = signA | (expA << C_FP32_MANT_WIDTH) | mantA;
+                    const fp32 opB = signB | (expB << C_FP32_MANT_WIDTH) | mantB;
+
+                    fp32_accuType acc;
+                    uint32_t      ref = 0;
+                    pcsMac(opA, opB, 1, subEn, 1, acc, ref);
+
+                    const fp32 res = pcsMul(opA, opB, subEn);
+                    nChecks++;
+
+                    if(res != ref && nErrors++ < 10)
+                        printf("  %08X * %08X (subEn %u): %08X instead of %08X\n",
+                               opA, opB, subEn, res, ref);
+                }
+            }
+        }
+    }
+
+    printf("%llu products: %s\n", (unsigned long long)nChecks, nErrors ? "FAILED" : "ok");
+
+    return nErrors ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// checks the timing estimates of setPerfModel and estimateCmd against
+// hand-derived cycle counts and utilizations. the TCDM grants everything,
+// and a command of MAC steps runs as in clusterModel.cpp: the controller
+// takes it in its first cycle, issues the init step and then one step per
+// cycle. the issue cycles end with the last step, the cycles with the write
+// back of its result, 12 cycles later (read, operand FIFO, C_FP32_MAC_LAT).
+//
+// usage: perfModel
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#define NTX_EMULATION_ON
+
+#include "ntx_api.hpp"
+
+#define C_TCDM_MEMSIZE (1<<16)
+
+static uint32_t nErrors = 0;
+
+static void
+check(const char * what, uint64_t value, uint64_t expected) {
+    if(value != expected && nErrors++ < 20)
+        printf("  %s: %llu instead of %llu\n", what, (unsigned long long)value, (unsigned long long)expected);
+}
+
+static void
+checkUtil(const char * what, double value, uint64_t steps, uint64_t cycles) {
+    if(fabs(value - (double)steps / cycles) > 1e-12 && nErrors++ < 20)
+        printf("  %s: utilization %f instead of %llu/%llu\n", what, value,
+               (unsigned long long)steps, (unsigned long long)cycles);
+}
+
+// stages nDots dot products of length n on ntx, with the init and the
+// store of each one at loop level 1
+static void
+stageDots(ntx_api & ntx, uint32_t * tcdm, uint32_t n, uint32_t nDots) {
+
+    nst_loopType   loopBound;
+    nst_strideType aguStride;
+    for(uint32_t l=0; l < C_N_HW_LOOPS; l++) {
+        loopBound[l] = 1;
+        for(uint32_t o=0; o < C_N_AGUS; o++)
+            aguStride[o][l] = 0;
+    }
+    loopBound[0]    = n;
+    loopBound[1]    = nDots;
+    aguStride[0][0] = 1;
+    aguStride[0][1] = n;
+    aguStride[1][0] = 1;
+    aguStride[2][1] = 1;
+
+    ntx.stageLoopNest(1, 1, nDots > 1 ? 2 : 1, loopBound, aguStride);
+    ntx.stageAguOffs(tcdm, tcdm + C_TCDM_MEMSIZE/2, tcdm + C_TCDM_MEMSIZE - nDots);
+    ntx.stageCmd(C_NTX_MAC_OP, C_NTX_INIT_WITH_ZERO, 0, C_NTX_SET_CMD_IRQ, 0);
+}
+
+// one dot product of 1024 steps: the steps are issued in cycles 2..1025,
+// so the next command can start after 1026 cycles. the last step is read
+// in cycle 1026 and its result written back in cycle 1038.
+static void
+macRow(uint32_t * tcdm) {
+    const uint32_t n = 1024;
+
+    ntx_api ntx(0);
+    ntx.setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+
+    stageDots(ntx, tcdm, n, 1);
+    const ntxPerfEstimate est = ntx.estimateCmd();
+
+    ntx.setPerfModel(true);
+    ntx.issueCmd();
+    const ntxPerfEstimate & p = ntx.lastPerf;
+
+    check("MAC row: cycles",       p.cycles,      n + 15);
+    check("MAC row: issue cycles", p.issueCycles, n + 2);
+    check("MAC row: steps",        p.steps,       n);
+    check("MAC row: end cycle",    p.endCycle,    n + 15);
+    checkUtil("MAC row", p.utilization, n, n + 2);
+
+    check("MAC row: estimateCmd cycles",       est.cycles,      p.cycles);
+    check("MAC row: estimateCmd issue cycles", est.issueCycles, p.issueCycles);
+}
+
+// 256 dot products of length 4 in one command, with the init and the store
+// at loop level 1: every dot product takes an init step and 4 steps, 5
+// cycles from cycle 1 on, so the last step is issued in cycle 1280. the
+// write backs need a free port. both ports read in all cycles but the one
+// after each init step, so the results wait for it, apart from the last
+// one: read in cycle 1281, written back in 1293.
+static void
+innerLevel(uint32_t * tcdm) {
+    const uint32_t n     = 4;
+    const uint32_t nDots = 256;
+
+    ntx_api ntx(0);
+    ntx.setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+    ntx.setPerfModel(true);
+
+    stageDots(ntx, tcdm, n, nDots);
+    ntx.issueCmd();
+    const ntxPerfEstimate & p = ntx.lastPerf;
+
+    check("init/store: cycles",       p.cycles,      1294);
+    check("init/store: issue cycles", p.issueCycles, 1281);
+    check("init/store: steps",        p.steps,       n * nDots);
+    checkUtil("init/store", p.utilization, n * nDots, 1281);
+}
+
+// dot products of length 4, one command each. each command takes 19 cycles
+// on its own, 6 of them issue cycles. the next command starts right after
+// the last step of the previous one, while the FPU still works on it, so a
+// command ends every 6 cycles.
+static void
+backToBack(uint32_t * tcdm) {
+    const uint32_t n     = 4;
+    const uint32_t nCmds = 16;
+
+    ntx_api ntx(0);
+    ntx.setTcdmBaseCheck(tcdm, tcdm + C_TCDM_MEMSIZE - 1);
+    ntx.setPerfModel(true);
+
+    stageDots(ntx, tcdm, n, 1);
+    for(uint32_t k=0; k < nCmds; k++) {
+        ntx.issueCmd();
+        const ntxPerfEstimate & p = ntx.lastPerf;
+
+        check("back to back: cycles",       p.cycles,      19);
+        check("back to back: issue cycles", p.issueCycles, 6);
+        check("back to back: end cycle",    p.endCycle,    19 + 6*k);
+        checkUtil("back to back", p.utilization, n, 6);
+    }
+}
+
+int
+main(int argc, char ** argv) {
+
+    uint32_t * tcdm = new uint32_t[C_TCDM_MEMSIZE];
+    for(uint32_t k=0; k < C_TCDM_MEMSIZE; k++)
+        tcdm[k] = floatTofp32((float)(int)(k % 64) - 32.0f);
+
+    macRow(tcdm);
+    innerLevel(tcdm);
+    backToBack(tcdm);
+
+    delete [] tcdm;
+
+    printf("perf model: %s\n", nErrors ? "FAILED" : "ok");
+
+    return nErrors ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "pcs_mac.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// random numbers of the tests. a 64bit LCG with the upper half of the state
+// as output: fast, and the same sequence on every host, so that the outputs
+// of different builds can be compared. each test has its own state, and
+// reseeds it by assigning rndState.
+///////////////////////////////////////////////////////////////////////////////
+
+static uint64_t rndState = 1;
+
+static inline uint32_t
+rnd() {
+    rndState = rndState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(rndState >> 32);
+}
+
+static inline uint64_t
+rnd64() {
+    const uint64_t hi = rnd();
+    return (hi << 32) | rnd();
+}
+
+// operand of format F with a random sign, an exponent in [expLo, expHi] and
+// a random mantissa, and signed zeros now and then
+template <class F = fmtFp32>
+static inline uint32_t
+rndOp(int32_t expLo = 0, int32_t expHi = F::maxExp) {
+    if(rnd() % 16 == 0)
+        return rnd() & F::signMask;
+    const uint32_t exp  = expLo + rnd() % (expHi - expLo + 1);
+    const uint32_t sign = rnd() & F::signMask;
+    return sign | (exp << F::mantWidth) | (rnd() & F::mantMask);
+}
@@ -0,0 +1,187 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "ntx_api.hpp"
+#include "rnd.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// random TCDM contents and commands of the command fuzzers (fuzzCmds,
+// fuzzBroadcast and asyncCmds), and the hash of the state that a command
+// leaves behind. the commands are plain values with word offsets into the
+// TCDM, so that the same command can be staged on several NTXs and TCDMs.
+///////////////////////////////////////////////////////////////////////////////
+
+#define C_TCDM_MEMSIZE (1<<16)
+
+// minimum number of iterations of the commands that are split across the
+// thread pool, see C_NTX_PAR_MIN_ITERS in ntx_api.cpp
+#define C_PAR_MIN_ITERS (1<<14)
+
+struct rndCmdType {
+    uint32_t       init, inner, outer;
+    nst_loopType   loopBound;
+    nst_strideType aguStride;
+    uint32_t       off[C_N_AGUS];
+    bool           inPlace[2];
+    uint32_t       opCode, initSel, auxFunc, polarity;
+};
+
+// zeros, small integers for the counters, infinities, NaNs, denormals and
+// normal numbers of similar magnitude
+static inline uint32_t
+rndVal() {
+    switch(rnd() % 16) {
+        case 0:  return C_FP32_ZERO_VAL;
+        case 1:  return 0x80000000;
+        case 2:  return floatTofp32((float)(int)(rnd() % 5) - 2.0f);
+        case 3:  return (rnd() & 0x80000000) | 0x7F800000 | (rnd() % 4 ? 0 : rnd() & 0x7FFFFF);
+        case 4:  return (rnd() & 0x807FFFFF) | ((rnd() % 30) << 23);
+        case 5:  return rnd() % 8;
+        default: return (rnd() & 0x807FFFFF) | ((110 + rnd() % 30) << 23);
+    }
+}
+
+// offset of an operand of a small nest, around the middle of the TCDM
+static inline uint32_t
+rndOff() {
+    return C_TCDM_MEMSIZE/2 - 4096 + rnd() % 8192;
+}
+
+// turns the nest into one with at least C_PAR_MIN_ITERS iterations: a long
+// row, short middle levels and as many outer iterations as needed. the
+// inner levels are contiguous or constant, and the outer level of agu2 (and
+// sometimes of agu0/1) steps over the inner levels, so that the outputs of
+// different outer iterations are disjoint and the nest can be split. the
+// offsets are placed anywhere in the TCDM where the nest fits.
+static inline void
+makeLarge(rndCmdType & cmd) {
+
+    const uint32_t p = cmd.outer - 1;
+
+    uint32_t inner = 1;
+    for(uint32_t l=0; l < p; l++) {
+        cmd.loopBound[l] = (l == 0) ? 16 + rnd() % 112 : 1 + rnd() % 2;
+        inner *= cmd.loopBound[l];
+    }
+    cmd.loopBound[p] = C_PAR_MIN_ITERS / inner + 1 + rnd() % 128;
+
+    for(uint32_t o=0; o < C_N_AGUS; o++) {
+        int32_t span = 1;
+        for(uint32_t l=0; l < p; l++) {
+            cmd.aguStride[o][l] = rnd() % 3 ? 1 : 0;
+            span += cmd.aguStride[o][l] * (cmd.loopBound[l] - 1);
+        }
+        cmd.aguStride[o][p] = (o == 2 || rnd() % 2) ? span : rnd() % 3;
+
+        const uint32_t size = span + cmd.aguStride[o][p] * (cmd.loopBound[p] - 1);
+        cmd.off[o] = rnd() % (C_TCDM_MEMSIZE - size);
+    }
+}
+
+// random command. the rows are short or up to 300 steps long, the strides
+// mostly small, contiguous or constant, and operands 0/1 are now and then
+// read and written exactly in place of operand 2. with largeEn, one command
+// in 16 is large enough to be split across the thread pool (see makeLarge).
+static inline void
+rndCmd(rndCmdType & cmd, bool largeEn = true) {
+
+    const bool large = largeEn && rnd() % 16 == 0;
+    cmd.outer = large ? 2 + rnd() % 4 : 1 + rnd() % 5;
+    cmd.inner = rnd() % (cmd.outer + 1);
+    cmd.init  = cmd.inner + rnd() % (cmd.outer - cmd.inner + 1);
+
+    for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+        cmd.loopBound[l] = 1 + rnd() % (l == 0 ? 12 : 4);
+    if(rnd() % 4 == 0)
+        cmd.loopBound[0] = 1 + rnd() % 300;
+
+    for(uint32_t o=0; o < C_N_AGUS; o++) {
+        for(uint32_t l=0; l < C_N_HW_LOOPS; l++) {
+            const uint32_t r = rnd() % 10;
+            cmd.aguStride[o][l] = r < 3 ? 0 : r < 6 ? rnd() % 3 : (int32_t)(rnd() % 17) - 8;
+        }
+        // contiguous and constant rows
+        if(rnd() % 2)
+            cmd.aguStride[o][0] = rnd() % 5 ? 1 : 0;
+        cmd.off[o] = rndOff();
+    }
+
+    if(large)
+        makeLarge(cmd);
+
+    for(uint32_t o=0; o < 2; o++) {
+        cmd.inPlace[o] = rnd() % 4 == 0;
+        if(cmd.inPlace[o]) {
+            cmd.off[o] = cmd.off[2];
+            for(uint32_t l=0; l < C_N_HW_LOOPS; l++)
+                cmd.aguStride[o][l] = cmd.aguStride[2][l];
+        }
+    }
+
+    cmd.opCode   = rnd() % C_N_NTX_OPCODES;
+    cmd.initSel  = rnd() % 4;
+    cmd.auxFunc  = rnd() % 8;
+    cmd.polarity = rnd() % 2;
+}
+
+static inline void
+stageRndCmd(ntx_api & ntx, const rndCmdType & cmd, uint32_t * tcdm) {
+    ntx.stageLoopNest(cmd.init, cmd.inner, cmd.outer, cmd.loopBound, cmd.aguStride);
+    ntx.stageAguOffs(tcdm + cmd.off[0], tcdm + cmd.off[1], tcdm + cmd.off[2]);
+    ntx.stageCmd(cmd.opCode, cmd.initSel, cmd.auxFunc, C_NTX_SET_CMD_IRQ, cmd.polarity);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// hashes
+///////////////////////////////////////////////////////////////////////////////
+
+#define C_HASH_SEED 1469598103934665603ULL
+
+static inline uint64_t
+hash(uint64_t h, uint32_t v) {
+    return (h ^ v) * 1099511628211ULL;
+}
+
+// the state that a command leaves behind in ntx, with the AGUs relative to
+// the TCDM
+static inline uint64_t
+hashState(uint64_t h, const ntx_api & ntx, const uint32_t * tcdm) {
+    h = hash(h, ntx.aluState);
+    h = hash(h, ntx.cntState);
+    h = hash(h, ntx.idxState);
+    h = hash(h, ntx.prodState);
+    h = hash(h, ntx.irqReg);
+    // the accumulator of MASKMAC, normalized
+    uint32_t acc;
+    pcsToFp32(ntx.maskAccuState, acc);
+    h = hash(h, acc);
+    // the accumulator of MAC and VADDSUB, word by word
+    fp32_accuType csAcc;
+    csToPcs(ntx.csAccuState, csAcc);
+    for(int32_t k = 0; k<C_FP32_N_ACCU_WORDS; k++) {
+        h = hash(h, (uint32_t)csAcc.word(k));
+        h = hash(h, (uint32_t)(csAcc.word(k) >> 32));
+    }
+    for(uint32_t o=0; o < C_N_AGUS; o++)
+        h = hash(h, (uint32_t)((uint32_t *)ntx.agu[o] - tcdm));
+    return h;
+}
+
+static inline uint64_t
+hashTcdm(uint64_t h, const uint32_t * tcdm) {
+    for(uint32_t k=0; k < C_TCDM_MEMSIZE; k++)
+        h = hash(h, tcdm[k]);
+    return h;
+}
@@ -0,0 +1,189 @@
+// Copyright 2017-2019 ETH Zurich and University of Bologna.
+//
+// Copyright and related rights are licensed under the Solderpad Hardware
+// License, Version 0.51 (the "License"); you may not use this file except in
+// compliance with the License.  You may obtain a copy of the License at
+// http://solderpad.org/licenses/SHL-0.51. Unless required by applicable law
+// or agreed to in writing, software, hardware and materials distributed under
+// this License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// prints a binary trace written by an NTX_TRACE_ON build (see ntx_trace.hpp)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ntx_api.hpp"
+#include "ntx_trace.hpp"
+
+static const char *
+opName(uint8_t opCode) {
+    switch(opCode) {
+        case C_NTX_MAC_OP:     return "NTX_MAC";
+        case C_NTX_VADDSUB_OP: return "NTX_VADDSUB";
+        case C_NTX_VMULT_OP:   return "NTX_VMULT";
+        case C_NTX_OUTERP_OP:  return "NTX_OUTERP";
+        case C_NTX_MAXMIN_OP:  return "NTX_MAXMIN";
+        case C_NTX_THTST_OP:   return "NTX_THTST";
+        case C_NTX_MASK_OP:    return "NTX_MASK";
+        case C_NTX_MASKMAC_OP: return "NTX_MASKMAC";
+        case C_NTX_COPY_OP:    return "NTX_COPY";
+        default:               return "NTX_UNKNOWN";
+    }
+}
+
+static void
+printAccu(const char * name, const ntxTraceRec & rec) {
+    for(int32_t k = C_FP32_N_ACCU_WORDS-1; k>=0; k--)
+        printf("%s.w[%d]: %016" PRIX64 "\n", name, k, rec.w[k]);
+}
+
+static void
+printRec(const ntxTraceRec & rec) {
+
+    const uint32_t a0 = rec.arg[0];
+    const uint32_t a1 = rec.arg[1];
+    const uint32_t a2 = rec.arg[2];
+
+    switch(rec.point) {
+
+        // MAC model
+        case C_NTX_TRACE_PCS_MAC_CALL:
+            printf("----------------------------------------------\n");
+            printf("pcsMac called with args:\n");
+            printf("opA: %08X (interpreted: %e)\n", a0, fp32ToFloat(a0));
+            printf("opB: %08X (interpreted: %e)\n", a1, fp32ToFloat(a1));
+            printf("accuSel: %d\n", rec.flags & 1);
+            printf("subEn: %d\n", (rec.flags >> 1) & 1);
+            printf("normEn: %d\n", (rec.flags >> 2) & 1);
+            printAccu("accuState", rec);
+            return;
+        case C_NTX_TRACE_PCS_MAC_MULT:
+            printf("--\n");
+            printf("after multiplication:\n");
+            printf("signTmp: %d\n", a0);
+            printf("expTmp: %02X\n", a1);
+            printf("mant: %016" PRIX64 "\n", rec.w[0]);
+            return;
+        case C_NTX_TRACE_PCS_MAC_EXT:
+            printf("--\n");
+            printf("after conversion of mult out:\n");
+            printAccu("tmp1", rec);
+            return;
+        case C_NTX_TRACE_PCS_MAC_ACCU:
+            printf("--\n");
+            printf("after accumulator:\n");
+            printAccu("accuState", rec);
+            return;
+        case C_NTX_TRACE_PCS_MAC_NORM:
+            printf("--\n");
+            printf("after norm:\n");
+            printf("res: %08X (interpreted: %e)\n", a0, fp32ToFloat(a0));
+            printf("----------------------------------------------\n");
+            return;
+        case C_NTX_TRACE_PCS_TO_FP32:
+            printf("--\n");
+            printf("pcsToFp32:\n");
+            printAccu("accuState", rec);
+            printf("tmpExp[end] = %d\n", (int32_t)a0);
+            printf("res: %08X (interpreted: %e)\n", a1, fp32ToFloat(a1));
+            return;
+        case C_NTX_TRACE_PCS_ADD_WORD:
+            printf("--\n");
+            printf("pcsAdd:\n");
+            printf("out: %016" PRIX64 " = opA.w + opB.w + carryIn = %016" PRIX64 "  + %016" PRIX64 " + %u, carryOut: %u\n",
+                   rec.w[0], rec.w[1], rec.w[2], rec.flags & 1, (rec.flags >> 1) & 1);
+            return;
+
+        // NTX looper
+        case C_NTX_TRACE_LEVEL:
+            for(uint32_t k=rec.flags; k<a0;k++)
+                printf("---");
+            printf("level %d\n", rec.flags);
+            return;
+        case C_NTX_TRACE_AGU_UPD:
+            printf("level %d AGU update (isLast = %d)\n", rec.flags, a0);
+            return;
+
+        // NTX ops, followed by the command configuration below
+        case C_NTX_TRACE_INIT_ZERO:
+            printf("init accu with zero\n");
+            break;
+        case C_NTX_TRACE_INIT_ACCU:
+            printf("init accu with %f (0x%08X)\n", fp32ToFloat(a0), a0);
+            break;
+        case C_NTX_TRACE_INIT_ALU:
+            printf("init alu with %f (0x%08X)\n", fp32ToFloat(a0), a0);
+            if(rec.flags)
+                printf("init accu with %f (0x%08X)\n", fp32ToFloat(a1), a1);
+            break;
+        case C_NTX_TRACE_NO_INIT:
+            printf("no init\n");
+            break;
+        case C_NTX_TRACE_FETCH:
+            printf("fetching:");
+            if(rec.flags & C_NTX_TRACE_FETCH_A)
+                printf(" opA = %f (0x%08X)", fp32ToFloat(a0), a0);
+            if(rec.flags & C_NTX_TRACE_FETCH_B)
+                printf(" opB = %f (0x%08X)", fp32ToFloat(a1), a1);
+            if(rec.flags & C_NTX_TRACE_FETCH_ALU)
+                printf(" aluState = %f (0x%08X)", fp32ToFloat(a2), a2);
+            printf("\n");
+            break;
+        case C_NTX_TRACE_STORE:
+            printf("storing: res = %f (0x%08X)\n", fp32ToFloat(a0), a0);
+            break;
+        case C_NTX_TRACE_NO_STORE:
+            printf("not storing since comparison returned false\n");
+            break;
+        default:
+            printf("unknown trace point 0x%X\n", rec.point);
+            return;
+    }
+
+    printf("op: %s (init: 0x%X, polarity: %u, auxFunc: %X)\n", opName(rec.opCode),
+           rec.cfg & 0xFF, (rec.cfg >> 8) & 0xFF, (rec.cfg >> 16) & 0xFF);
+    printf("agu: 0x%016" PRIX64 " 0x%016" PRIX64 " 0x%016" PRIX64 "\n", rec.ptr[0], rec.ptr[1], rec.ptr[2]);
+}
+
+int
+main(int argc, char ** argv) {
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s TRACEFILE\n", argv[0]);
+        return 1;
+    }
+
+    FILE * fid = fopen(argv[1], "rb");
+    if (!fid) {
+        fprintf(stderr, "unable to open trace file %s\n", argv[1]);
+        return 1;
+    }
+
+    ntxTraceFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fid) != 1 ||
+        hdr.magic   != C_NTX_TRACE_MAGIC ||
+        hdr.version != C_NTX_TRACE_VERSION ||
+        hdr.recSize != sizeof(ntxTraceRec)) {
+        fprintf(stderr, "%s is not a trace file of this version\n", argv[1]);
+        fclose(fid);
+        return 1;
+    }
+
+    // records of different threads are interleaved in blocks
+    ntxTraceRec rec;
+    uint32_t tid = 0;
+    while (fread(&rec, sizeof(rec), 1, fid) == 1) {
+        if (rec.tid != tid) {
+            printf("=== thread %u ===\n", rec.tid);
+            tid = rec.tid;
+        }
+        printRec(rec);
+    }
+
+    fclose(fid);
+    return 0;
+}